@@ -1,10 +1,14 @@
 // APPLICATION LAYER
 // Source file of the BMP180 component.
 
+// compile time log level of this hot path, see general.h
+#define LOG_COMPONENT_LEVEL CONFIG_LOG_LEVEL_AL_BMP180
+
 // components
 #include "./al_bmp180.h"
 
 #include "../general/general.h"
+#include "../logger/logger.h"
 #include "../pl_i2c/pl_i2c.h"
 
 // esp-idf
@@ -282,45 +286,39 @@ int32_t al_bmp180_get_up(uint8_t slave_addr, uint8_t oss) {
     return up;
 }
 
-int32_t al_bmp180_get_temperature() {
-    int32_t ut = al_bmp180_get_ut(fd_BMP);
-    int32_t t, x1, x2;
+/** Compensate the uncompensated temperature.
+
+**Parameters**
+    - ut: uncompensated temperature
+    - *b5: output of the intermediate value `b5` which is
+        needed for the pressure compensation
+
+**Return**
+    - t: temperature in units of 0.1 celsius
+*/
+int32_t compensate_temperature(int32_t ut, int32_t *b5) {
+    int32_t x1, x2;
     // algorithm for the temperature
     x1 = ((ut - calib_param.ac6) * calib_param.ac5) >> 15;
     x2 = (calib_param.mc << 11) / (x1 + calib_param.md);
-    b5 = x1 + x2;
-    t = (b5 + 8) >> 4;
+    *b5 = x1 + x2;
+    return (*b5 + 8) >> 4;
+}
 
-    // divide the temperature by 10 to get the value in multiples of 1.0 celsius
-    ESP_LOGD(TAG,
-             "temperature in degree celsius: %.1f",
-             (float)t / 10);
+/** Compensate the uncompensated pressure.
 
-    return t;
-}
+**Parameters**
+    - up: uncompensated pressure
+    - b5: intermediate value of the temperature compensation
+    - oss: oversampling setting `up` was converted with
 
-int32_t al_bmp180_get_pressure(uint8_t oss) {
-    int32_t up = 0;
+**Return**
+    - p: pressure in units of Pa
+*/
+int32_t compensate_pressure(int32_t up, int32_t b5, uint8_t oss) {
     int32_t p, x1, x2, x3, b3, b6;
     uint32_t b4, b7;
 
-    if (oss > 3) {
-        ESP_LOGW(TAG,
-                 "Sampling mode for pressure measurement is to high: %d",
-                 oss);
-        //  set it to the max value
-        oss = 3;
-    }
-
-    if (b5 == 0xFFFFFFFF) {
-        ESP_LOGW(TAG,
-                 "The value of b5 is not initialized.");
-        return 0;
-    }
-
-    // get the uncompensated pressure
-    up = al_bmp180_get_up(fd_BMP, oss);
-
     // algorithm for the pressure conversion
     b6 = b5 - 4000;
     x1 = (calib_param.b2 * ((b6 * b6) >> 12)) >> 11;
@@ -340,12 +338,70 @@ int32_t al_bmp180_get_pressure(uint8_t oss) {
     x1 = (p >> 8) * (p >> 8);
     x1 = (x1 * 3038) >> 16;
     x2 = (-7357 * p) >> 16;
-    p = p + ((x1 + x2 + 3791) >> 4);
+    return p + ((x1 + x2 + 3791) >> 4);
+}
 
-    // divide by 100 because the pressure was in Pa instead of hPa before
-    ESP_LOGD(TAG,
-             "Pressure in hekto pascal : %4.2f",
-             (float)p / 100);
+int32_t al_bmp180_get_temperature() {
+    int32_t ut = al_bmp180_get_ut(fd_BMP);
+    int32_t t = compensate_temperature(ut, &b5);
+
+    // the temperature is in multiples of 0.1 celsius, no
+    // floats for the deferred log
+    LOGGER_D(TAG,
+             "temperature in 0.1 degree celsius: %d",
+             t);
+
+    return t;
+}
+
+int32_t al_bmp180_get_pressure(uint8_t oss) {
+    int32_t up = 0;
+    int32_t p;
+
+    if (oss > 3) {
+        ESP_LOGW(TAG,
+                 "Sampling mode for pressure measurement is to high: %d",
+                 oss);
+        //  set it to the max value
+        oss = 3;
+    }
+
+    if (b5 == 0xFFFFFFFF) {
+        ESP_LOGW(TAG,
+                 "The value of b5 is not initialized.");
+        return 0;
+    }
+
+    // get the uncompensated pressure
+    up = al_bmp180_get_up(fd_BMP, oss);
+    p = compensate_pressure(up, b5, oss);
+
+    LOGGER_D(TAG,
+             "pressure in pascal: %d",
+             p);
 
     return p;
 }
+
+void al_bmp180_get_temperature_pressure(uint8_t oss,
+                                        int32_t *t,
+                                        int32_t *p) {
+    int32_t b5_local;
+
+    if (oss > 3) {
+        ESP_LOGW(TAG,
+                 "Sampling mode for pressure measurement is to high: %d",
+                 oss);
+        //  set it to the max value
+        oss = 3;
+    }
+
+    // one temperature conversion is shared by both values
+    *t = compensate_temperature(al_bmp180_get_ut(fd_BMP), &b5_local);
+    *p = compensate_pressure(al_bmp180_get_up(fd_BMP, oss), b5_local, oss);
+
+    LOGGER_D(TAG,
+             "temperature in 0.1 degree celsius: %d, pressure in pascal: %d",
+             *t,
+             *p);
+}
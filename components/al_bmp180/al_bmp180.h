@@ -56,4 +56,26 @@ int32_t al_bmp180_get_temperature();
 */
 int32_t al_bmp180_get_pressure(uint8_t oss);
 
+/** Get the real temperature and pressure.
+
+**Requirement**
+    Initialize the BMP180 component with `al_bmp180_init`.
+
+**Parameters**
+    - oss: 
+        oversampling setting of the pressure, see `oss` in
+        `al_bmp_180_get_up`
+    - *t: output for the temperature in units of 0.1 celsius
+    - *p: output for the pressure in units of Pa
+
+**Description**
+    Do one temperature and one pressure conversion. The
+    pressure is compensated with the value of `b5` from this
+    temperature conversion and not from an earlier call of
+    `al_bmp180_get_temperature`.
+*/
+void al_bmp180_get_temperature_pressure(uint8_t oss,
+                                        int32_t *t,
+                                        int32_t *p);
+
 #endif  // _AL_BMP180_H_
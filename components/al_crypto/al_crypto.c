@@ -1,31 +1,82 @@
 // APPLICATION LAYER
 // Source file of the Crypto component.
 
+// compile time log level of this hot path, see general.h
+#define LOG_COMPONENT_LEVEL CONFIG_LOG_LEVEL_AL_CRYPTO
+
 #include "al_crypto.h"
 
 #include "../general/general.h"
+#include "../registry/registry.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+#include "nvs.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "string.h"
 
 static const char* TAG = "al_crypto";
 
-// number of the maximum possible plaintext characters
-#define BUFFER_LENGTH 256
-
 // key string from config
 char key_string[65] = CONFIG_AES_256_KEY;
 
-byte_t iv[16];
-byte_t buffer_in[BUFFER_LENGTH];
-byte_t buffer_out[BUFFER_LENGTH];
-byte_t buffer_plaintext[BUFFER_LENGTH + 1];
-byte_t buffer_ciphertext[BUFFER_LENGTH + 17];
-
-// aes context needed for init
-mbedtls_aes_context ctx;
+#ifdef CONFIG_AES_256_MODE_GCM
+// maximum number of keys in the keyring
+#define MAX_KEYS 4
+// not a valid key id
+#define NO_KEY 0xff
+
+// a retiring key in NVS with the rest of its overlap window
+typedef struct retiring_key_t {
+    uint8_t id;
+    // seconds until the key is removed
+    uint32_t remaining;
+} retiring_key_t;
+
+// one key of the keyring with its expanded contexts. the
+// contexts hold the state of the message in progress, the
+// encryption contexts are guarded by `enc_lock` and the
+// decryption contexts by `dec_lock`. changes of the keyring
+// take both locks.
+typedef struct crypto_key_t {
+    uint8_t id;
+    bool used;
+    // monotonic time in microseconds after which the key is
+    // removed, 0 if it does not expire
+    int64_t expires;
+    mbedtls_gcm_context ctx_enc;
+    mbedtls_gcm_context ctx_dec;
+} crypto_key_t;
+
+crypto_key_t keyring[MAX_KEYS];
+// key used for sending
+crypto_key_t* active_key = NULL;
+SemaphoreHandle_t enc_lock;
+SemaphoreHandle_t dec_lock;
+
+// number of nonce counters reserved with one NVS write
+#define COUNTER_BLOCK 4096
+
+// the nonce is the id of this sender and a counter that
+// never repeats, also across reboots. all counters below
+// `counter_reserved` may have been used before.
+uint32_t sender_id;
+uint64_t counter;
+uint64_t counter_reserved;
+// nvs of the counter and the keyring
+nvs_handle_t crypto_nvs;
+#else
+// aes contexts with the expanded keys. they are only written
+// by `al_crypto_init`, the per message state lives in the
+// frames of the callers.
+mbedtls_aes_context ctx_enc;
+mbedtls_aes_context ctx_dec;
+#endif
 
 /** Print the numbers 0 to length with spaces separated
 
@@ -85,24 +136,6 @@ void print_chars(char* chars, int length) {
     printf("\n");
 }
 
-/** Copy a byte array
-
-**Parameters**
-    - *old : byte array containing the data
-    - *new : byte array where the data is copied into
-    - len : length of byte arrays
-
-**Description**
-    In a loop copy the values from one byte array to the
-    other one. Only the first len bytes are copied regard
-    less of the length of the arrays.
-*/
-void copy_bytes(byte_t* old, byte_t* new, int len) {
-    for (int i = 0; i < len; ++i) {
-        new[i] = old[i];
-    }
-}
-
 /** Convert a hex string of chars into an array of bytes
 
 **Parameters**
@@ -144,18 +177,12 @@ void convert_hex2bytes(char* chars,
     - start : starting index for padding
     - stop : stopping indeex for padding (excluded)
 
-**Requirements**
-    Message musst be null terminated so strlen on it does
-    not return an error.
-
 **Description**
-    Determine the length of the message in the array. Then
-    fill up the remaining space with zeros until the end.
+    Fill up the space after the message with zeros until
+    the end.
 */
 void message_padding(byte_t* message, int start, int stop) {
-    for (size_t i = start; i < stop; ++i) {
-        message[i] = '\0';
-    }
+    memset(message + start, 0, stop - start);
     ESP_LOGV(TAG,
              "message padding from %d to %d bytes",
              start,
@@ -179,182 +206,815 @@ void generate_iv(byte_t* iv, int len) {
     ESP_LOGV(TAG, "generated iv with %d bytes", len);
 }
 
-void al_crypto_init() {
-    byte_t key_bytes[32];
+/** Convert bytes into a hex string
 
-    // read in key string
-    convert_hex2bytes(key_string, key_bytes, 32);
-    ESP_LOGD(TAG, "key string: %s", key_string);
+**Parameters**
+    - *bytes : array of bytes
+    - length : number of bytes
+    - *chars : buffer for 2 * length + 1 chars
+*/
+void convert_bytes2hex(const byte_t* bytes, int length, char* chars) {
+    static const char digits[] = "0123456789abcdef";
+
+    // look up the nibbles instead of one sprintf per byte
+    for (int i = 0; i < length; ++i) {
+        chars[2 * i] = digits[bytes[i] >> 4];
+        chars[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+    chars[2 * length] = '\0';
+}
 
-    mbedtls_aes_init(&ctx);
-    mbedtls_aes_setkey_enc(&ctx, key_bytes, 256);
-    // mbedtls_aes_setkey_dec(&ctx, key, 256);
+#ifdef CONFIG_AES_256_MODE_GCM
 
-    ESP_LOGI(TAG, "init finished");
+/** Write a big endian number into bytes
+
+**Parameters**
+    - *bytes : destination
+    - value : the number
+    - length : number of bytes
+*/
+void write_be(byte_t* bytes, uint64_t value, int length) {
+    for (int i = length - 1; i >= 0; --i) {
+        bytes[i] = value & 0xff;
+        value >>= 8;
+    }
 }
 
-byte_t* al_crypto_encrypt(byte_t* plaintext) {
-    // length of the plaintext in bytes
-    int len = strlen((char*)plaintext);
-    int cipher_len;
+/** Read a big endian number from bytes
 
-    ESP_LOGD(TAG,
-             "encrypting text of length %d bytes",
-             len);
+**Parameters**
+    - *bytes : source
+    - length : number of bytes
 
-    // check if the plaintext is too long
-    if (len > BUFFER_LENGTH) {
-        ESP_LOGW(TAG,
-                 "Cannot encrypt a message of length %d bytes, max length is %d bytes. Aborting!",
-                 len,
-                 BUFFER_LENGTH);
+**Return**
+    The number.
+*/
+uint64_t read_be(const byte_t* bytes, int length) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < length; ++i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+/** Continue at a random high counter without NVS
+
+**Description**
+    The counters are not persisted for the rest of the boot,
+    a reuse of a stored one after a reboot is unlikely.
+*/
+void randomize_counter() {
+    counter = (uint64_t)esp_random() << 32;
+    counter_reserved = UINT64_MAX;
+}
+
+/** Reserve the next block of nonce counters in NVS
+
+**Description**
+    Store the end of the block before any counter of it is
+    used. After a reboot the counter continues behind the
+    stored value, so at most one block is skipped. The block
+    only counts as reserved after the commit succeeded,
+    otherwise the counter jumps to a random high one.
+*/
+void reserve_counters() {
+    uint64_t reserved = counter + COUNTER_BLOCK;
+    esp_err_t err;
+
+    err = nvs_set_u64(crypto_nvs, "counter", reserved);
+    if (err == ESP_OK) {
+        err = nvs_commit(crypto_nvs);
+    }
+    if (err == ESP_OK) {
+        counter_reserved = reserved;
         return;
     }
 
-    generate_iv(iv, 16);
+    // after a reboot the counters behind the stored block
+    // would be used again
+    log_status(TAG, err, "reserve nonce counters");
+    randomize_counter();
+}
+
+/** Load the nonce counter from NVS
+
+**Description**
+    Take the sender id from the MAC address and continue the
+    counter behind the last reserved block. Without NVS
+    start at a random high counter so a reuse is unlikely.
+*/
+void load_counter() {
+    byte_t mac[6];
+    esp_err_t err;
 
-    // copy IV into ciphertext
-    for (int i = 0; i < 16; ++i) {
-        buffer_ciphertext[i] = iv[i];
+    esp_efuse_mac_get_default(mac);
+    sender_id = read_be(mac + 2, 4);
+
+    err = nvs_open("al_crypto", NVS_READWRITE, &crypto_nvs);
+    if (err != ESP_OK) {
+        log_status(TAG, err, "open nvs for the nonce counter");
+        randomize_counter();
+        return;
     }
-    ESP_LOGV(TAG, "copied iv into ciphertext");
 
-    // copy message into buffer
-    for (int i = 0; i < len; ++i) {
-        buffer_in[i] = plaintext[i];
+    err = nvs_get_u64(crypto_nvs, "counter", &counter);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        counter = 0;
+    } else if (err != ESP_OK) {
+        log_status(TAG, err, "read nonce counter");
+        counter = (uint64_t)esp_random() << 32;
+    }
+    reserve_counters();
+
+    ESP_LOGI(TAG, "sender id %08x, nonce counter %llu", sender_id, counter);
+}
+
+/** Generate the nonce of the next frame
+
+**Parameters**
+    - *nonce : buffer of `AL_CRYPTO_HEADER_LENGTH` bytes
+
+**Requirements**
+    Hold `enc_lock`.
+
+**Description**
+    Write the sender id and the counter big endian and
+    advance the counter. Reserve a new block when the
+    counter reaches the reserved one.
+*/
+void generate_nonce(byte_t* nonce) {
+    write_be(nonce, sender_id, 4);
+    write_be(nonce + 4, counter, 8);
+    counter++;
+    if (counter >= counter_reserved) {
+        reserve_counters();
+    }
+}
+
+/** Find a key of the keyring
+
+**Parameters**
+    - id : id of the key
+
+**Return**
+    The key or NULL if the keyring has no key with the id.
+*/
+crypto_key_t* find_key(uint8_t id) {
+    for (int i = 0; i < MAX_KEYS; ++i) {
+        if (keyring[i].used && keyring[i].id == id) {
+            return &keyring[i];
+        }
+    }
+    return NULL;
+}
+
+/** Store the list of key ids and the state of the keyring
+
+**Description**
+    The key bytes are stored by `install_key`. Here the ids
+    of all keys, the id of the active key and every
+    retiring key with the rest of its overlap window are
+    written, so a key rotated twice within the overlap
+    still expires after a reboot.
+*/
+void save_keyring() {
+    uint8_t ids[MAX_KEYS];
+    retiring_key_t retiring[MAX_KEYS];
+    int num_ids = 0;
+    int num_retiring = 0;
+    int64_t now = esp_timer_get_time();
+    esp_err_t err;
+
+    for (int i = 0; i < MAX_KEYS; ++i) {
+        if (keyring[i].used) {
+            ids[num_ids++] = keyring[i].id;
+            if (keyring[i].expires != 0) {
+                retiring[num_retiring].id = keyring[i].id;
+                retiring[num_retiring].remaining =
+                    (keyring[i].expires > now) ? (keyring[i].expires - now) / 1000000 : 0;
+                num_retiring++;
+            }
+        }
+    }
+
+    err = nvs_set_blob(crypto_nvs, "key_ids", ids, num_ids);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(crypto_nvs, "key_id", active_key->id);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_blob(crypto_nvs,
+                           "keys_retiring",
+                           retiring,
+                           num_retiring * sizeof(retiring_key_t));
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(crypto_nvs);
+    }
+    log_status(TAG, err, "save keyring");
+}
+
+/** Add a key to the keyring or replace its bytes
+
+**Parameters**
+    - id : id of the key
+    - *key_bytes : 32 bytes of the key
+    - persist : store the key bytes in NVS
+
+**Return**
+    The key or NULL if the keyring is full.
+
+**Requirements**
+    Hold `enc_lock` and `dec_lock` unless the encryption is
+    not used yet.
+
+**Description**
+    Expand the key into one encryption and one decryption
+    context once, so the hot path never runs the key
+    schedule.
+*/
+crypto_key_t* install_key(uint8_t id, const byte_t* key_bytes, bool persist) {
+    crypto_key_t* key = find_key(id);
+    char name[8];
+
+    if (key == NULL) {
+        for (int i = 0; i < MAX_KEYS; ++i) {
+            if (!keyring[i].used) {
+                key = &keyring[i];
+                break;
+            }
+        }
+        if (key == NULL) {
+            ESP_LOGW(TAG, "keyring is full, cannot add key %d", id);
+            return NULL;
+        }
+    } else {
+        mbedtls_gcm_free(&key->ctx_enc);
+        mbedtls_gcm_free(&key->ctx_dec);
+    }
+
+    key->id = id;
+    key->used = true;
+    key->expires = 0;
+    mbedtls_gcm_init(&key->ctx_enc);
+    mbedtls_gcm_setkey(&key->ctx_enc, MBEDTLS_CIPHER_ID_AES, key_bytes, 256);
+    mbedtls_gcm_init(&key->ctx_dec);
+    mbedtls_gcm_setkey(&key->ctx_dec, MBEDTLS_CIPHER_ID_AES, key_bytes, 256);
+
+    if (persist) {
+        sprintf(name, "key%d", id);
+        log_status(TAG,
+                   nvs_set_blob(crypto_nvs, name, key_bytes, 32),
+                   "store key");
+    }
+    ESP_LOGI(TAG, "installed key %d", id);
+    return key;
+}
+
+/** Remove a key from the keyring
+
+**Parameters**
+    - *key : the key, must not be the active key
+
+**Requirements**
+    Hold `dec_lock`. The encryption only uses the active
+    key, so `enc_lock` is not needed.
+*/
+void remove_key(crypto_key_t* key) {
+    char name[8];
+
+    mbedtls_gcm_free(&key->ctx_enc);
+    mbedtls_gcm_free(&key->ctx_dec);
+    key->used = false;
+    key->expires = 0;
+
+    sprintf(name, "key%d", key->id);
+    nvs_erase_key(crypto_nvs, name);
+    save_keyring();
+    ESP_LOGI(TAG, "removed key %d", key->id);
+}
+
+/** Load the keyring from NVS
+
+**Description**
+    Install all stored keys. A key that was retiring before
+    the reboot keeps the rest of its overlap window, the
+    time since the last save is not counted. If the keyring
+    is empty install the key from the config with id 0.
+*/
+void load_keyring() {
+    uint8_t ids[MAX_KEYS];
+    size_t num_ids = sizeof(ids);
+    retiring_key_t retiring[MAX_KEYS];
+    size_t retiring_len = sizeof(retiring);
+    size_t num_retiring;
+    uint8_t active_id = 0;
+    byte_t key_bytes[32];
+    size_t key_len;
+    crypto_key_t* key;
+    char name[8];
+
+    if (nvs_get_blob(crypto_nvs, "key_ids", ids, &num_ids) != ESP_OK) {
+        num_ids = 0;
+    }
+    nvs_get_u8(crypto_nvs, "key_id", &active_id);
+    if (nvs_get_blob(crypto_nvs, "keys_retiring", retiring, &retiring_len) != ESP_OK) {
+        retiring_len = 0;
+    }
+    num_retiring = retiring_len / sizeof(retiring_key_t);
+
+    for (int i = 0; i < num_ids; ++i) {
+        sprintf(name, "key%d", ids[i]);
+        key_len = sizeof(key_bytes);
+        if (nvs_get_blob(crypto_nvs, name, key_bytes, &key_len) == ESP_OK && key_len == 32) {
+            key = install_key(ids[i], key_bytes, false);
+            for (int r = 0; key != NULL && r < num_retiring; ++r) {
+                if (retiring[r].id == ids[i]) {
+                    // an expired key is removed on its next use
+                    key->expires = esp_timer_get_time() +
+                                   (int64_t)retiring[r].remaining * 1000000;
+                }
+            }
+        }
+    }
+    active_key = find_key(active_id);
+
+    if (active_key == NULL) {
+        // first boot, start with the key of the config
+        convert_hex2bytes(key_string, key_bytes, 32);
+        active_key = install_key(0, key_bytes, true);
+        save_keyring();
+    }
+    ESP_LOGI(TAG, "keyring loaded, sending with key %d", active_key->id);
+}
+
+/** Check if a string consists of hex digits
+
+**Parameters**
+    - *chars : the string
+    - length : expected number of digits
+
+**Return**
+    True if the string has exactly `length` hex digits.
+*/
+bool is_hex(const char* chars, int length) {
+    for (int i = 0; i < length; ++i) {
+        if (!((chars[i] >= '0' && chars[i] <= '9') ||
+              (chars[i] >= 'a' && chars[i] <= 'f') ||
+              (chars[i] >= 'A' && chars[i] <= 'F'))) {
+            return false;
+        }
+    }
+    return chars[length] == '\0';
+}
+
+/** Setter of the registry entry `key`
+
+**Parameters**
+    - *value : `<id>:<64 hex digits>` to add or replace a
+        key, `<id>:` to remove a key
+
+**Return**
+    - err: `ESP_ERR_INVALID_ARG` for a malformed value or
+        when removing the active key, `ESP_ERR_NO_MEM` if the
+        keyring is full and `ESP_OK` otherwise
+*/
+esp_err_t set_key(const char* value) {
+    char* hex;
+    long id = strtol(value, &hex, 10);
+    byte_t key_bytes[32];
+    crypto_key_t* key;
+    esp_err_t err = ESP_OK;
+
+    if (hex == value || *hex != ':' || id < 0 || id >= NO_KEY) {
+        return ESP_ERR_INVALID_ARG;
     }
-    ESP_LOGV(TAG, "copied plaintext into buffer");
+    hex++;
+
+    xSemaphoreTake(enc_lock, portMAX_DELAY);
+    xSemaphoreTake(dec_lock, portMAX_DELAY);
+    if (*hex == '\0') {
+        key = find_key(id);
+        if (key == NULL || key == active_key) {
+            err = ESP_ERR_INVALID_ARG;
+        } else {
+            remove_key(key);
+        }
+    } else if (is_hex(hex, 64)) {
+        convert_hex2bytes(hex, key_bytes, 32);
+        if (install_key(id, key_bytes, true) == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            save_keyring();
+        }
+        memset(key_bytes, 0, sizeof(key_bytes));
+    } else {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreGive(dec_lock);
+    xSemaphoreGive(enc_lock);
+    return err;
+}
+
+// getter and setter of the registry entry `key_id`
+int32_t get_key_id() {
+    return active_key->id;
+}
 
-    message_padding(buffer_in,
-                    len,
-                    BUFFER_LENGTH);
-    ESP_LOGV(TAG, "padding of buffer");
+esp_err_t set_key_id(int32_t id) {
+    crypto_key_t* key;
+
+    xSemaphoreTake(enc_lock, portMAX_DELAY);
+    xSemaphoreTake(dec_lock, portMAX_DELAY);
+    key = find_key(id);
+    if (key != NULL && key != active_key) {
+        // keep accepting the old key for the overlap window
+        active_key->expires = esp_timer_get_time() +
+                              (int64_t)CONFIG_AES_256_KEY_OVERLAP * 1000000;
+        key->expires = 0;
+        active_key = key;
+        save_keyring();
+        ESP_LOGI(TAG, "sending with key %d", active_key->id);
+    }
+    xSemaphoreGive(dec_lock);
+    xSemaphoreGive(enc_lock);
+
+    return (key == NULL) ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+static const registry_entry_t key_entry = {
+    .name = "key",
+    .type = REGISTRY_STRING,
+    .set_string = set_key,
+    .admin = true};
+
+static const registry_entry_t key_id_entry = {
+    .name = "key_id",
+    .type = REGISTRY_INT,
+    .min = 0,
+    .max = NO_KEY - 1,
+    .get = get_key_id,
+    .set = set_key_id,
+    .admin = true};
+
+/** Encrypt the message of a frame and append the tag
+
+**Parameters**
+    - *ctx : GCM context with the key
+    - *frame : frame with the key id and the nonce written
+    - length : length of the message in bytes
 
-    ESP_LOGV(TAG, "buffer_in: %s", buffer_in);
+**Return**
+    The error code of mbedtls, 0 on success.
+
+**Description**
+    The nonce is taken from the frame, the additional data
+    is empty. Also used by the known answer test.
+*/
+int seal_gcm(mbedtls_gcm_context* ctx, byte_t* frame, int length) {
+    byte_t* message = frame + AL_CRYPTO_HEADER_LENGTH;
+
+    return mbedtls_gcm_crypt_and_tag(ctx,
+                                     MBEDTLS_GCM_ENCRYPT,
+                                     length,
+                                     frame + 1,
+                                     AL_CRYPTO_NONCE_LENGTH,
+                                     NULL,
+                                     0,
+                                     message,
+                                     message,
+                                     AL_CRYPTO_TAG_LENGTH,
+                                     message + length);
+}
+
+/** Check the tag of a frame and decrypt its message
+
+**Parameters**
+    - *ctx : GCM context with the key
+    - *frame : the received frame
+    - length : length of the message in bytes
+
+**Return**
+    The error code of mbedtls, 0 on success.
+
+**Description**
+    Counterpart of `seal_gcm`. Also used by the known
+    answer test.
+*/
+int open_gcm(mbedtls_gcm_context* ctx, byte_t* frame, int length) {
+    byte_t* message = frame + AL_CRYPTO_HEADER_LENGTH;
+
+    return mbedtls_gcm_auth_decrypt(ctx,
+                                    length,
+                                    frame + 1,
+                                    AL_CRYPTO_NONCE_LENGTH,
+                                    NULL,
+                                    0,
+                                    message + length,
+                                    AL_CRYPTO_TAG_LENGTH,
+                                    message,
+                                    message);
+}
+
+/** Encrypt a message in place with AES-GCM mode
+
+**Description**
+    Write the id of the key and the nonce in front of the
+    message, encrypt the message in place and append the
+    tag. A retired key is only used until the end of its
+    overlap window, like for the decryption.
+*/
+esp_err_t encrypt_gcm(byte_t* frame, int length, uint8_t key_id, int* frame_length) {
+    crypto_key_t* key;
+    int err;
+
+    xSemaphoreTake(enc_lock, portMAX_DELAY);
+    key = (key_id == AL_CRYPTO_ACTIVE_KEY) ? active_key : find_key(key_id);
+    if (key == NULL || (key->expires != 0 && esp_timer_get_time() > key->expires)) {
+        xSemaphoreGive(enc_lock);
+        ESP_LOGW(TAG, "cannot encrypt with unknown key %d", key_id);
+        return ESP_ERR_NOT_FOUND;
+    }
+    frame[0] = key->id;
+    generate_nonce(frame + 1);
+    err = seal_gcm(&key->ctx_enc, frame, length);
+    xSemaphoreGive(enc_lock);
+
+    if (err != 0) {
+        ESP_LOGW(TAG, "gcm encryption failed: -0x%04x", -err);
+        return ESP_FAIL;
+    }
+
+    *frame_length = AL_CRYPTO_HEADER_LENGTH + length + AL_CRYPTO_TAG_LENGTH;
+    return ESP_OK;
+}
+
+/** Check and decrypt a frame in place with AES-GCM mode
+
+**Description**
+    Look up the key by the id in the first byte. A retired
+    key is removed on its first use after the overlap
+    window. mbedtls compares the tag before it releases the
+    plaintext and wipes it on a mismatch.
+*/
+esp_err_t decrypt_gcm(byte_t* frame, int frame_length, byte_t** message, int* length) {
+    crypto_key_t* key;
+    int err;
+
+    if (!al_crypto_check_length(frame_length)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *length = frame_length - AL_CRYPTO_HEADER_LENGTH - AL_CRYPTO_TAG_LENGTH;
+    *message = frame + AL_CRYPTO_HEADER_LENGTH;
+
+    xSemaphoreTake(dec_lock, portMAX_DELAY);
+    key = find_key(frame[0]);
+    if (key != NULL && key->expires != 0 && esp_timer_get_time() > key->expires) {
+        remove_key(key);
+        key = NULL;
+    }
+    if (key == NULL) {
+        xSemaphoreGive(dec_lock);
+        ESP_LOGW(TAG, "frame with unknown key %d", frame[0]);
+        return ESP_ERR_NOT_FOUND;
+    }
+    err = open_gcm(&key->ctx_dec, frame, *length);
+    xSemaphoreGive(dec_lock);
+
+    if (err != 0) {
+        ESP_LOGW(TAG, "frame of %d bytes failed authentication", frame_length);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
 
-    // encrypt the message
-    mbedtls_aes_crypt_cbc(&ctx,
+#else
+
+/** Encrypt a message in place with AES-CBC mode
+
+**Description**
+    Pad the message with zeros to the maximum length,
+    generate an IV in front of it and encrypt it in place.
+*/
+esp_err_t encrypt_cbc(byte_t* frame, int length, int* frame_length) {
+    byte_t* message = frame + AL_CRYPTO_HEADER_LENGTH;
+    // the IV is updated by the encryption, keep the one in
+    // the frame
+    byte_t iv[AL_CRYPTO_HEADER_LENGTH];
+
+    message_padding(message,
+                    length,
+                    AL_CRYPTO_MESSAGE_LENGTH);
+
+    generate_iv(frame, AL_CRYPTO_HEADER_LENGTH);
+    memcpy(iv, frame, AL_CRYPTO_HEADER_LENGTH);
+
+    mbedtls_aes_crypt_cbc(&ctx_enc,
                           ESP_AES_ENCRYPT,
-                          BUFFER_LENGTH,
+                          AL_CRYPTO_MESSAGE_LENGTH,
                           iv,
-                          buffer_in,
-                          buffer_out);
-    ESP_LOGV(TAG, "encrypted buffer");
+                          message,
+                          message);
+
+    *frame_length = AL_CRYPTO_FRAME_LENGTH;
+    return ESP_OK;
+}
+
+/** Decrypt a frame in place with AES-CBC mode
+
+**Description**
+    Decrypt behind the IV. The message ends at the first
+    padding zero.
+*/
+esp_err_t decrypt_cbc(byte_t* frame, int frame_length, byte_t** message, int* length) {
+    byte_t iv[AL_CRYPTO_HEADER_LENGTH];
+    int cipher_len = frame_length - AL_CRYPTO_HEADER_LENGTH;
 
-    // copy encrypted buffer into ciphertext after IV
-    for (int i = 0; i < BUFFER_LENGTH; ++i) {
-        buffer_ciphertext[16 + i] = buffer_out[i];
+    if (!al_crypto_check_length(frame_length)) {
+        return ESP_ERR_INVALID_SIZE;
     }
-    // null terminate the string
-    buffer_ciphertext[BUFFER_LENGTH + 16] = '\0';
 
-    cipher_len = strlen((char*)buffer_ciphertext);
-    ESP_LOGV(TAG,
-             "ciphertext length: %d bytes, %.2f words",
-             cipher_len,
-             (double)cipher_len / 16.);
+    // read the IV from the frame
+    memcpy(iv, frame, AL_CRYPTO_HEADER_LENGTH);
+    *message = frame + AL_CRYPTO_HEADER_LENGTH;
 
-    al_crypto_log_ciphertext(buffer_ciphertext);
+    mbedtls_aes_crypt_cbc(&ctx_dec,
+                          ESP_AES_DECRYPT,
+                          cipher_len,
+                          iv,
+                          *message,
+                          *message);
 
-    return buffer_ciphertext;
+    *length = strnlen((char*)*message, cipher_len);
+    return ESP_OK;
 }
 
-byte_t* al_crypto_decrypt(byte_t* ciphertext, int length) {
-    int plain_len;
-    int cipher_len;
+#endif
+
+// PUBLIC FUNCTIONS
+
+void al_crypto_init() {
+#ifdef CONFIG_AES_256_MODE_GCM
+    enc_lock = xSemaphoreCreateMutex();
+    dec_lock = xSemaphoreCreateMutex();
+    load_counter();
+    load_keyring();
+
+    // make the keys configurable by requests
+    registry_register(&key_entry);
+    registry_register(&key_id_entry);
+    ESP_LOGI(TAG, "init finished in GCM mode");
+#else
+    byte_t key_bytes[32];
+
+    // read in key string
+    convert_hex2bytes(key_string, key_bytes, 32);
+    ESP_LOGD(TAG, "key string: %s", key_string);
+
+    mbedtls_aes_init(&ctx_enc);
+    mbedtls_aes_setkey_enc(&ctx_enc, key_bytes, 256);
+    mbedtls_aes_init(&ctx_dec);
+    mbedtls_aes_setkey_dec(&ctx_dec, key_bytes, 256);
+    ESP_LOGI(TAG, "init finished in CBC mode");
+#endif
+}
+
+esp_err_t al_crypto_encrypt(byte_t* frame, int length, uint8_t key_id, int* frame_length) {
+    esp_err_t err;
 
     ESP_LOGD(TAG,
-             "decrypting text of length %d bytes",
+             "encrypting text of length %d bytes",
              length);
 
-    // check if the ciphertext is too long
-    if (length > (BUFFER_LENGTH + 16)) {
+    // check if the plaintext is too long
+    if (length > AL_CRYPTO_MESSAGE_LENGTH) {
         ESP_LOGW(TAG,
-                 "Cannot decrypt a message of length %d, max length %d bytes. Aborting!",
+                 "Cannot encrypt a message of length %d bytes, max length is %d bytes. Aborting!",
                  length,
-                 BUFFER_LENGTH);
-        return;
+                 AL_CRYPTO_MESSAGE_LENGTH);
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    // read the IV from ciphertext
-    for (int i = 0; i < 16; ++i) {
-        iv[i] = ciphertext[i];
-    }
-    ESP_LOGV(TAG, "read iv from ciphertext");
+#ifdef CONFIG_AES_256_MODE_GCM
+    err = encrypt_gcm(frame, length, key_id, frame_length);
+#else
+    err = encrypt_cbc(frame, length, frame_length);
+#endif
 
-    // copy ciphertext into buffer
-    for (int i = 16; i < length; ++i) {
-        buffer_in[i - 16] = ciphertext[i];
+    if (err == ESP_OK) {
+        ESP_LOGV(TAG, "encrypted buffer");
+        al_crypto_log_ciphertext(frame, *frame_length);
     }
-    cipher_len = length - 16;
-    ESP_LOGV(TAG,
-             "copied ciphertext into buffer %d bytes, %.2f words",
-             cipher_len,
-             (double)cipher_len / 16.);
+    return err;
+}
 
-    // decrypt the message
-    mbedtls_aes_crypt_cbc(&ctx,
-                          ESP_AES_DECRYPT,
-                          cipher_len,
-                          iv,
-                          buffer_in,
-                          buffer_out);
-    ESP_LOGV(TAG, "decrypted buffer");
+esp_err_t al_crypto_decrypt(byte_t* frame,
+                            int frame_length,
+                            byte_t** message,
+                            int* length) {
+    esp_err_t err;
+
+    ESP_LOGD(TAG,
+             "decrypting text of length %d bytes",
+             frame_length);
 
-    // copy the buffer into plaintext only up to cipher_len
-    for (int i = 0; i < cipher_len; i++) {
-        buffer_plaintext[i] = buffer_out[i];
+#ifdef CONFIG_AES_256_MODE_GCM
+    err = decrypt_gcm(frame, frame_length, message, length);
+#else
+    err = decrypt_cbc(frame, frame_length, message, length);
+#endif
+
+    if (err == ESP_ERR_INVALID_SIZE) {
+        ESP_LOGW(TAG,
+                 "Cannot decrypt a message of length %d, max length %d bytes. Aborting!",
+                 frame_length,
+                 AL_CRYPTO_FRAME_LENGTH);
+    }
+    if (err != ESP_OK) {
+        return err;
     }
-    // null terminate the string
-    buffer_plaintext[cipher_len] = '\0';
 
-    plain_len = strlen((char*)buffer_plaintext);
+    // null terminate behind the message
+    (*message)[*length] = '\0';
+
     ESP_LOGV(TAG,
              "plaintext length: %d bytes, %.2f words",
-             plain_len,
-             (double)plain_len / 16.);
+             *length,
+             (double)*length / 16.);
 
-    return buffer_plaintext;
+    return ESP_OK;
 }
 
-void al_crypto_log_ciphertext(byte_t* ciphertext) {
-    byte_t byte;
-    char buffer[3];
-    char chars1[33];
-    char chars2[33];
-    char chars3[33];
-    int length = strlen((char*)ciphertext);
+bool al_crypto_check_length(int frame_length) {
+#ifdef CONFIG_AES_256_MODE_GCM
+    int length = frame_length - AL_CRYPTO_HEADER_LENGTH - AL_CRYPTO_TAG_LENGTH;
 
-    // IV
-    for (int i = 0; i < 16; ++i) {
-        byte = ciphertext[i];
-        sprintf(buffer, "%02x", byte);
-        chars1[2 * i] = buffer[0];
-        chars1[2 * i + 1] = buffer[1];
-    }
-    chars1[32] = '\0';
+    return length >= 0 && length <= AL_CRYPTO_MESSAGE_LENGTH;
+#else
+    int cipher_len = frame_length - AL_CRYPTO_HEADER_LENGTH;
+
+    // whole blocks of the padded message
+    return cipher_len >= AL_CRYPTO_BLOCK_LENGTH &&
+           cipher_len <= AL_CRYPTO_MESSAGE_LENGTH &&
+           cipher_len % AL_CRYPTO_BLOCK_LENGTH == 0;
+#endif
+}
 
-    // first 16 bytes of the ciphertext
-    for (int i = 0; i < 16; ++i) {
-        byte = ciphertext[i + 16];
-        sprintf(buffer, "%02x", byte);
-        chars2[2 * i] = buffer[0];
-        chars2[2 * i + 1] = buffer[1];
+esp_err_t al_crypto_get_sequence(const byte_t* frame,
+                                 int frame_length,
+                                 uint32_t* sender,
+                                 uint64_t* sequence) {
+#ifdef CONFIG_AES_256_MODE_GCM
+    if (frame_length < AL_CRYPTO_HEADER_LENGTH + AL_CRYPTO_TAG_LENGTH) {
+        return ESP_ERR_INVALID_SIZE;
     }
-    chars2[32] = '\0';
+    *sender = read_be(frame + 1, 4);
+    *sequence = read_be(frame + 5, 8);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
 
-    // last 16 bytes of the ciphertext
-    for (int i = 0; i < 16; ++i) {
-        byte = ciphertext[length - 16 + i];
-        sprintf(buffer, "%02x", byte);
-        chars3[2 * i] = buffer[0];
-        chars3[2 * i + 1] = buffer[1];
+uint8_t al_crypto_get_key_id(const byte_t* frame, int frame_length) {
+#ifdef CONFIG_AES_256_MODE_GCM
+    if (frame_length >= AL_CRYPTO_HEADER_LENGTH) {
+        return frame[0];
     }
-    chars3[32] = '\0';
+#endif
+    return AL_CRYPTO_ACTIVE_KEY;
+}
+
+bool al_crypto_may_manage_keys(uint8_t key_id) {
+#ifdef CONFIG_AES_256_MODE_GCM
+    bool allowed;
+
+    xSemaphoreTake(enc_lock, portMAX_DELAY);
+    allowed = (key_id == active_key->id);
+    xSemaphoreGive(enc_lock);
+    return allowed;
+#else
+    return true;
+#endif
+}
+
+void al_crypto_log_ciphertext(byte_t* frame, int frame_length) {
+#if LOG_LOCAL_LEVEL >= 4  // ESP_LOG_DEBUG
+    char chars1[2 * AL_CRYPTO_HEADER_LENGTH + 1];
+    char chars2[33];
+    char chars3[33];
+
+    // nonce or IV
+    convert_bytes2hex(frame, AL_CRYPTO_HEADER_LENGTH, chars1);
+    // first 16 bytes behind the header
+    convert_bytes2hex(frame + AL_CRYPTO_HEADER_LENGTH, 16, chars2);
+    // last 16 bytes of the frame
+    convert_bytes2hex(frame + frame_length - 16, 16, chars3);
 
     ESP_LOGD(TAG,
              "ciphertext: %s %s ... %s",
              chars1,
              chars2,
              chars3);
+#endif
 }
@@ -4,79 +4,210 @@
 #ifndef _AL_CRYPTO_H_
 #define _AL_CRYPTO_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// length of an AES block in bytes
+#define AL_CRYPTO_BLOCK_LENGTH 16
+// maximum length of a message
+#define AL_CRYPTO_MESSAGE_LENGTH 256
+
+#ifdef CONFIG_AES_256_MODE_GCM
+// frame: [key id][nonce][ciphertext of the message length][tag]
+// nonce: [sender id, 4 bytes][counter, 8 bytes] big endian
+#define AL_CRYPTO_NONCE_LENGTH 12
+#define AL_CRYPTO_HEADER_LENGTH (1 + AL_CRYPTO_NONCE_LENGTH)
+#define AL_CRYPTO_TAG_LENGTH 16
+#else
+// frame: [IV][ciphertext padded to the maximum length]
+#define AL_CRYPTO_HEADER_LENGTH 16
+#define AL_CRYPTO_TAG_LENGTH 0
+#endif
+
+// maximum length of an encrypted frame
+#define AL_CRYPTO_FRAME_LENGTH \
+    (AL_CRYPTO_HEADER_LENGTH + AL_CRYPTO_MESSAGE_LENGTH + AL_CRYPTO_TAG_LENGTH)
+
+// key id to encrypt with the active key, no valid key id
+#define AL_CRYPTO_ACTIVE_KEY 0xff
+
 typedef unsigned char byte_t;
 
 /** Initialize the al_crypto component
 
 **Requirements**
     A key string of length 64 hex digits must be specified
-    in the config.
+    in the config. NVS must be initialized. Call it before
+    `pl_udp_init` and `dl_wifi_init`, the frame functions
+    use the keys and locks without a check.
 
 **Description**
     Convert the key hex string into bytes and initialize
-    the mbedtls aes stuff with the key.
+    one mbedtls context for encryption and one for
+    decryption with the key for the configured mode. In GCM
+    mode load the nonce counter and the keyring from NVS and
+    register the variables `key` and `key_id`.
 */
 void al_crypto_init();
 
-/** Encrypt the plain text with AES-CBC mode
+/** Encrypt a message in place
 
 **Parameters**
-    - *plaintext : byte array of the plain text
-
-**Returns**
-    - *ciphertext : byte array of the cipher text
+    - *frame :
+        buffer of `AL_CRYPTO_FRAME_LENGTH` bytes, the
+        message starts at `frame + AL_CRYPTO_HEADER_LENGTH`
+    - length : length of the message in bytes
+    - key_id : id of the key, `AL_CRYPTO_ACTIVE_KEY` for
+        the active key
+    - *frame_length : output for the length of the frame
+
+**Return**
+    - err: `ESP_ERR_INVALID_SIZE` if the message is longer
+        than `AL_CRYPTO_MESSAGE_LENGTH`, `ESP_ERR_NOT_FOUND`
+        if the key is not in the keyring, `ESP_FAIL` if
+        mbedtls fails and `ESP_OK` otherwise
 
 **Requirements**
     Component al_cypto must be initialized with
-    `al_crypto_init()`. The length of the plaintext has to
-    be less than the maximum buffer length.
+    `al_crypto_init()`.
 
 **Description**
-    Generate an IV. Encrypt the plaintext in AES-CBC mode
-    with the specified initialization vector (IV). The key
-    was set during initialization. Prepend the IV to the
-    ciphertext. Log the ciphertext.
+    Generate the nonce or IV in front of the message and
+    encrypt the message in place. GCM frames start with the
+    id of the key. A reply takes the key of its request, so
+    a client only needs the key it sends with. A GCM nonce is the sender
+    id from the MAC address and a counter that is persisted
+    in NVS in blocks, so no nonce is used twice. In GCM mode
+    append the tag, in CBC mode ignore the key id and pad the message with zeros to the
+    maximum length. Only the caller owned frame is written,
+    so several tasks can encrypt at the same time.
 */
-byte_t* al_crypto_encrypt(byte_t* plaintext);
+esp_err_t al_crypto_encrypt(byte_t* frame, int length, uint8_t key_id, int* frame_length);
 
-/** Decrypt the cipher text with AES-CBC mode
+/** Decrypt a frame in place
 
 **Parameters**
-    - *ciphertext : byte array of the cipher text
-    - length : length of the ciphertext in bytes
-
-**Returns** 
-    - *plaintext : byte array for the plain text
+    - *frame :
+        the received frame, the buffer must hold one byte
+        more than `frame_length` for the terminating null
+    - frame_length : length of the frame in bytes
+    - **message : output for the start of the message
+    - *length : output for the length of the message
+
+**Return**
+    - err: `ESP_ERR_INVALID_SIZE` if the frame has an
+        invalid length, `ESP_ERR_NOT_FOUND` if the key is
+        not in the keyring, `ESP_ERR_INVALID_CRC` if the tag
+        does not match and `ESP_OK` otherwise
 
 **Requirements**
     Component al_cypto must be initialized with
-    `al_crypto_init()`. The IV must be 16 bytes long and
-    the first block of the cipher text. Ciphertext must be
-    a multiple of 16 bytes and not exced the buffer length
-    + 16 bytes for IV.
+    `al_crypto_init()`.
+
+**Description**
+    In GCM mode take the key with the id of the first byte,
+    check the tag of the frame and decrypt it in place. On a mismatch the decrypted bytes are wiped, so
+    a forged frame never reaches the JSON parser. In CBC
+    mode decrypt the frame behind the IV, the message ends
+    at the first padding zero. The message is null
+    terminated and points into the frame.
+*/
+esp_err_t al_crypto_decrypt(byte_t* frame,
+                            int frame_length,
+                            byte_t** message,
+                            int* length);
+
+/** Check the length of a received frame
+
+**Parameters**
+    - frame_length : length of the frame in bytes
+
+**Return**
+    True if a frame of this length can be decrypted.
 
 **Description**
-    Copy the IV from the ciphertext. Decrypt the ciphertext
-    in AES-CBC mode with the specified initialization vector
-    (IV). The key was set during initialization.
+    Cheap test before any other work on a frame. A GCM frame
+    holds the header, the tag and at most
+    `AL_CRYPTO_MESSAGE_LENGTH` bytes. A CBC frame holds the
+    IV and whole blocks.
 */
-byte_t* al_crypto_decrypt(byte_t* ciphertext, int length);
+bool al_crypto_check_length(int frame_length);
+
+/** Read the sender and sequence number of a frame
+
+**Parameters**
+    - *frame : the received frame
+    - frame_length : length of the frame in bytes
+    - *sender : output for the id of the sender
+    - *sequence : output for the nonce counter
+
+**Return**
+    - err: `ESP_ERR_NOT_SUPPORTED` in CBC mode,
+        `ESP_ERR_INVALID_SIZE` if the frame is too short and
+        `ESP_OK` otherwise
+
+**Description**
+    Parse the nonce without decrypting. The values are only
+    trustworthy after `al_crypto_decrypt` accepted the tag.
+*/
+esp_err_t al_crypto_get_sequence(const byte_t* frame,
+                                 int frame_length,
+                                 uint32_t* sender,
+                                 uint64_t* sequence);
+
+/** Read the key id of a frame
+
+**Parameters**
+    - *frame : the received frame
+    - frame_length : length of the frame in bytes
+
+**Return**
+    Id of the key of a GCM frame, `AL_CRYPTO_ACTIVE_KEY` in
+    CBC mode or for a frame that is too short.
+
+**Description**
+    The key to encrypt the reply to the frame with. Only
+    trustworthy after `al_crypto_decrypt` accepted the tag.
+*/
+uint8_t al_crypto_get_key_id(const byte_t* frame, int frame_length);
 
 /** Log the ciphertext
 
 **Parameters**
-    - *ciphertext : byte array of the ciphertext with IV
+    - *frame : the encrypted frame
+    - frame_length : length of the frame in bytes
 
 **Prerequisites**
-    The ciphertext must be at least 3 blocks of 16 bytes
-    long.
+    The frame must hold at least 16 bytes behind the
+    header.
+
+**Description**
+    Convert the header (nonce or IV) and then the first and
+    last 16 bytes behind it into a hex string
+    represantation. Then DEBUG log the blocks separated by
+    spaces. Compiled out if the local log level is below
+    DEBUG.
+*/
+void al_crypto_log_ciphertext(byte_t* frame, int frame_length);
+
+/** Check if a key may manage the keyring
+
+**Parameters**
+    - key_id : id of the key of a request, from
+        `al_crypto_get_key_id`
+
+**Return**
+    True for the active key and in CBC mode.
 
 **Description**
-    Convert the first 16 byte block (IV) and then the
-    first and last 16 byte blocks of the ciphertext into
-    a hex string represantation. Then DEBUG log the blocks
-    separated by spaces.
+    A retiring key or a key that was added but is not
+    active yet must not install, remove or activate keys.
+    The registry entries `key` and `key_id` are marked
+    `admin` for this check.
 */
-void al_crypto_log_ciphertext(byte_t* ciphertext);
+bool al_crypto_may_manage_keys(uint8_t key_id);
 
-#endif
\ No newline at end of file
+#endif
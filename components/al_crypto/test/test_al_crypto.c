@@ -0,0 +1,212 @@
+// APPLICATION LAYER
+// Source file of the tests of the Crypto component.
+
+#include "../al_crypto.h"
+
+#include "../../registry/registry.h"
+#include "mbedtls/gcm.h"
+#include "nvs_flash.h"
+#include "string.h"
+#include "unity.h"
+
+/** Init the component once for all test cases
+
+**Description**
+    The init registers the variables `key` and `key_id`,
+    which works only once per boot. Also used by the
+    benchmark.
+*/
+void test_al_crypto_setup() {
+    static bool initialized = false;
+
+    if (!initialized) {
+        TEST_ASSERT_EQUAL(ESP_OK, nvs_flash_init());
+        al_crypto_init();
+        initialized = true;
+    }
+}
+
+#ifdef CONFIG_AES_256_MODE_GCM
+
+// frame functions of al_crypto.c with an explicit context
+int seal_gcm(mbedtls_gcm_context* ctx, byte_t* frame, int length);
+int open_gcm(mbedtls_gcm_context* ctx, byte_t* frame, int length);
+
+// known answer generated with OpenSSL (EVP_aes_256_gcm):
+// key 0x00 to 0x1f, sender 0x24a16057, counter 4103 and an
+// empty additional data
+#define TEST_KEY_ID 1
+#define TEST_SENDER 0x24a16057
+#define TEST_COUNTER 4103
+
+static const char plaintext[] = "{\"type\":\"get\",\"name\":\"temperature\"}";
+#define TEST_LENGTH (sizeof(plaintext) - 1)
+
+static const byte_t header[AL_CRYPTO_HEADER_LENGTH] = {
+    TEST_KEY_ID,
+    0x24, 0xa1, 0x60, 0x57,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x07};
+
+static const byte_t ciphertext[TEST_LENGTH] = {
+    0xc6, 0xd2, 0xe9, 0x4a, 0xae, 0xf6, 0x08, 0x6e, 0x8a, 0x67, 0x41, 0x5d,
+    0x23, 0xae, 0x8d, 0x71, 0x86, 0xbd, 0xda, 0x50, 0xdb, 0x47, 0x0d, 0x00,
+    0x63, 0xdb, 0x37, 0x4d, 0x1e, 0x6d, 0xec, 0x7f, 0xab, 0xae, 0xad};
+
+static const byte_t tag[AL_CRYPTO_TAG_LENGTH] = {
+    0x17, 0x43, 0x28, 0x5e, 0xd4, 0x36, 0x8e, 0x5b,
+    0x66, 0xc9, 0xd4, 0xd0, 0xe8, 0x0e, 0x97, 0x31};
+
+// tag of the same frame with the key id as additional
+// data, which the frame format does not use
+static const byte_t tag_key_id_aad[AL_CRYPTO_TAG_LENGTH] = {
+    0xe2, 0x0b, 0xff, 0xde, 0xa4, 0x4e, 0x87, 0xf0,
+    0x4b, 0xe3, 0x48, 0xb2, 0x68, 0x37, 0x23, 0x44};
+
+// PRIVATE FUNCTIONS
+
+/** Set up a GCM context with the key of the known answer */
+static void init_test_key(mbedtls_gcm_context* ctx) {
+    byte_t key[32];
+
+    for (int i = 0; i < sizeof(key); ++i) {
+        key[i] = i;
+    }
+    mbedtls_gcm_init(ctx);
+    mbedtls_gcm_setkey(ctx, MBEDTLS_CIPHER_ID_AES, key, 256);
+}
+
+/** Write the known answer frame
+
+**Parameters**
+    - *frame : buffer of `AL_CRYPTO_FRAME_LENGTH` bytes
+    - *frame_tag : tag behind the ciphertext
+
+**Return**
+    Length of the frame in bytes.
+*/
+static int write_frame(byte_t* frame, const byte_t* frame_tag) {
+    memcpy(frame, header, AL_CRYPTO_HEADER_LENGTH);
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH, ciphertext, TEST_LENGTH);
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH + TEST_LENGTH, frame_tag, AL_CRYPTO_TAG_LENGTH);
+    return AL_CRYPTO_HEADER_LENGTH + TEST_LENGTH + AL_CRYPTO_TAG_LENGTH;
+}
+
+// TEST CASES
+
+/** Test the encryption against the known answer.
+
+**Description**
+    The frame holds the header, the ciphertext and the tag
+    byte by byte as OpenSSL computes them.
+*/
+TEST_CASE("GCM encryption of the known answer", "[al_crypto]") {
+    mbedtls_gcm_context ctx;
+    byte_t frame[AL_CRYPTO_FRAME_LENGTH];
+    byte_t expected[AL_CRYPTO_FRAME_LENGTH];
+    int frame_length = write_frame(expected, tag);
+
+    init_test_key(&ctx);
+    memcpy(frame, header, AL_CRYPTO_HEADER_LENGTH);
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH, plaintext, TEST_LENGTH);
+
+    TEST_ASSERT_EQUAL(0, seal_gcm(&ctx, frame, TEST_LENGTH));
+    TEST_ASSERT_EQUAL_MEMORY(expected, frame, frame_length);
+    mbedtls_gcm_free(&ctx);
+}
+
+/** Test the decryption of the known answer.
+
+**Description**
+    The frame decrypts to the plaintext. A flipped bit of
+    the tag and the tag over the key id as additional data
+    are both rejected.
+*/
+TEST_CASE("GCM decryption of the known answer", "[al_crypto]") {
+    mbedtls_gcm_context ctx;
+    byte_t frame[AL_CRYPTO_FRAME_LENGTH];
+    int frame_length;
+
+    init_test_key(&ctx);
+    write_frame(frame, tag);
+    TEST_ASSERT_EQUAL(0, open_gcm(&ctx, frame, TEST_LENGTH));
+    TEST_ASSERT_EQUAL_MEMORY(plaintext, frame + AL_CRYPTO_HEADER_LENGTH, TEST_LENGTH);
+
+    frame_length = write_frame(frame, tag);
+    frame[frame_length - 1] ^= 0x01;
+    TEST_ASSERT_NOT_EQUAL(0, open_gcm(&ctx, frame, TEST_LENGTH));
+
+    write_frame(frame, tag_key_id_aad);
+    TEST_ASSERT_NOT_EQUAL(0, open_gcm(&ctx, frame, TEST_LENGTH));
+    mbedtls_gcm_free(&ctx);
+}
+
+/** Test the nonce layout.
+
+**Description**
+    The sender and the counter of the known answer are read
+    back big endian. Two frames of the frame functions have
+    the same sender, a higher counter and decrypt again.
+*/
+TEST_CASE("GCM nonce of the frame functions", "[al_crypto]") {
+    byte_t frame[AL_CRYPTO_FRAME_LENGTH + 1];
+    byte_t* message;
+    int frame_length;
+    int length;
+    uint32_t sender;
+    uint32_t first_sender;
+    uint64_t sequence;
+    uint64_t first_sequence;
+
+    test_al_crypto_setup();
+    frame_length = write_frame(frame, tag);
+    TEST_ASSERT_EQUAL(ESP_OK, al_crypto_get_sequence(frame, frame_length, &sender, &sequence));
+    TEST_ASSERT_EQUAL(TEST_SENDER, sender);
+    TEST_ASSERT_EQUAL(TEST_COUNTER, sequence);
+
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH, plaintext, TEST_LENGTH);
+    TEST_ASSERT_EQUAL(ESP_OK, al_crypto_encrypt(frame, TEST_LENGTH, AL_CRYPTO_ACTIVE_KEY, &frame_length));
+    al_crypto_get_sequence(frame, frame_length, &first_sender, &first_sequence);
+
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH, plaintext, TEST_LENGTH);
+    TEST_ASSERT_EQUAL(ESP_OK, al_crypto_encrypt(frame, TEST_LENGTH, AL_CRYPTO_ACTIVE_KEY, &frame_length));
+    al_crypto_get_sequence(frame, frame_length, &sender, &sequence);
+    TEST_ASSERT_EQUAL(first_sender, sender);
+    TEST_ASSERT_TRUE(sequence > first_sequence);
+
+    TEST_ASSERT_EQUAL(ESP_OK, al_crypto_decrypt(frame, frame_length, &message, &length));
+    TEST_ASSERT_EQUAL(TEST_LENGTH, length);
+    TEST_ASSERT_EQUAL_MEMORY(plaintext, message, TEST_LENGTH);
+}
+
+/** Test who may manage the keyring.
+
+**Description**
+    A frame on the active key may set the registry entries
+    `key` and `key_id`, the same frame with any other key id
+    is rejected.
+*/
+TEST_CASE("only the active key manages the keys", "[al_crypto]") {
+    byte_t frame[AL_CRYPTO_FRAME_LENGTH + 1];
+    const registry_entry_t* key;
+    const registry_entry_t* key_id;
+    int frame_length;
+
+    test_al_crypto_setup();
+    key = registry_find("key");
+    key_id = registry_find("key_id");
+    TEST_ASSERT_TRUE(key != NULL && key->admin);
+    TEST_ASSERT_TRUE(key_id != NULL && key_id->admin);
+
+    memcpy(frame + AL_CRYPTO_HEADER_LENGTH, plaintext, TEST_LENGTH);
+    TEST_ASSERT_EQUAL(ESP_OK, al_crypto_encrypt(frame, TEST_LENGTH, AL_CRYPTO_ACTIVE_KEY, &frame_length));
+    TEST_ASSERT_TRUE(al_crypto_may_manage_keys(al_crypto_get_key_id(frame, frame_length)));
+
+    for (int id = 0; id < AL_CRYPTO_ACTIVE_KEY; id++) {
+        if (id != key_id->get()) {
+            frame[0] = id;
+            TEST_ASSERT_FALSE(al_crypto_may_manage_keys(al_crypto_get_key_id(frame, frame_length)));
+        }
+    }
+}
+
+#endif  // CONFIG_AES_256_MODE_GCM
@@ -0,0 +1,250 @@
+// APPLICATION LAYER
+// Source file of the benchmark of the Crypto component.
+
+#include "../al_crypto.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unity.h"
+
+static const char* TAG = "al_crypto";
+
+// init of test_al_crypto.c
+void test_al_crypto_setup();
+
+// message sizes of the raw cipher measurements in bytes
+static const int sizes[] = {16, 64, 256, 1024, 4096};
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define MAX_SIZE 4096
+// bytes processed per measurement, but at least
+// `MIN_ITERATIONS` calls
+#define BENCHMARK_BYTES 65536
+#define MIN_ITERATIONS 16
+
+typedef enum {
+    OP_ENCRYPT,
+    OP_DECRYPT
+} op_t;
+
+static const char* op_names[] = {"encrypt", "decrypt"};
+
+// PRIVATE FUNCTIONS
+
+/** Print one result as a JSON line
+
+**Parameters**
+    - *mode : cipher mode
+    - op : operation
+    - *api : `raw` for mbedtls alone, `frame` for the
+        al_crypto functions
+    - size : message size in bytes
+    - iterations : number of calls
+    - time_us : time of all calls in microseconds
+    - raw_us : time per call of the raw cipher for the
+        overhead of the frame functions, 0 for raw results
+
+**Description**
+    The cycles are derived from the time at the configured
+    CPU frequency, so dynamic frequency scaling must be off.
+*/
+static void print_result(const char* mode,
+                         op_t op,
+                         const char* api,
+                         int size,
+                         int iterations,
+                         int64_t time_us,
+                         double raw_us) {
+    // below the resolution of the timer
+    double us_per_call = (double)((time_us > 0) ? time_us : 1) / iterations;
+    double cycles_per_byte = us_per_call * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / size;
+
+    printf("{\"type\":\"benchmark\",\"mode\":\"%s\",\"op\":\"%s\",\"api\":\"%s\","
+           "\"size\":%d,\"iterations\":%d,\"us_per_call\":%.2f,"
+           "\"cycles_per_byte\":%.2f,\"mb_per_s\":%.3f",
+           mode, op_names[op], api, size, iterations, us_per_call,
+           cycles_per_byte, size / us_per_call);
+    if (raw_us > 0) {
+        printf(",\"overhead_us\":%.2f", us_per_call - raw_us);
+    }
+    printf("}\n");
+}
+
+/** Number of calls for a message size */
+static int get_iterations(int size) {
+    int iterations = BENCHMARK_BYTES / size;
+    return (iterations < MIN_ITERATIONS) ? MIN_ITERATIONS : iterations;
+}
+
+/** Time AES-CBC on one buffer
+
+**Return**
+    Time of all calls in microseconds.
+*/
+static int64_t time_cbc(mbedtls_aes_context* ctx, op_t op, byte_t* buffer, int size, int iterations) {
+    byte_t iv[16] = {0};
+    int mode = (op == OP_ENCRYPT) ? ESP_AES_ENCRYPT : ESP_AES_DECRYPT;
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < iterations; ++i) {
+        mbedtls_aes_crypt_cbc(ctx, mode, size, iv, buffer, buffer);
+    }
+    return esp_timer_get_time() - start;
+}
+
+/** Time AES-GCM on one buffer
+
+**Return**
+    Time of all calls in microseconds.
+
+**Description**
+    The decryption computes the tag but does not compare
+    it, the buffer changes with every call.
+*/
+static int64_t time_gcm(mbedtls_gcm_context* ctx, op_t op, byte_t* buffer, int size, int iterations) {
+    byte_t nonce[12] = {0};
+    byte_t tag[16];
+    int mode = (op == OP_ENCRYPT) ? MBEDTLS_GCM_ENCRYPT : MBEDTLS_GCM_DECRYPT;
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < iterations; ++i) {
+        mbedtls_gcm_crypt_and_tag(ctx, mode, size, nonce, sizeof(nonce),
+                                  NULL, 0, buffer, buffer, sizeof(tag), tag);
+    }
+    return esp_timer_get_time() - start;
+}
+
+/** Time the frame functions of al_crypto
+
+**Parameters**
+    - op : operation
+    - *frame : buffer of `AL_CRYPTO_FRAME_LENGTH + 1` bytes
+    - *copy : second buffer of the same size
+    - size : message size in bytes
+    - iterations : number of calls
+
+**Return**
+    Time of all calls in microseconds.
+
+**Description**
+    A frame is decrypted in place, so every call decrypts a
+    fresh copy. The time of the copies is measured alone and
+    subtracted.
+*/
+static int64_t time_frame(op_t op, byte_t* frame, byte_t* copy, int size, int iterations) {
+    byte_t* message;
+    int frame_length;
+    int length;
+    int64_t start;
+    int64_t copy_time;
+
+    memset(frame + AL_CRYPTO_HEADER_LENGTH, 'x', size);
+    if (op == OP_ENCRYPT) {
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; ++i) {
+            al_crypto_encrypt(frame, size, AL_CRYPTO_ACTIVE_KEY, &frame_length);
+        }
+        return esp_timer_get_time() - start;
+    }
+
+    al_crypto_encrypt(frame, size, AL_CRYPTO_ACTIVE_KEY, &frame_length);
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; ++i) {
+        memcpy(copy, frame, frame_length);
+    }
+    copy_time = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; ++i) {
+        memcpy(copy, frame, frame_length);
+        al_crypto_decrypt(copy, frame_length, &message, &length);
+    }
+    return esp_timer_get_time() - start - copy_time;
+}
+
+// TEST CASES
+
+/** Benchmark the ciphers
+
+**Description**
+    Measure encryption and decryption of CBC and GCM with
+    mbedtls alone for messages of 16 to 4096 bytes, then the
+    frame functions of the configured mode up to the maximum
+    message length. Print one JSON line per measurement with
+    the time per call, the cycles per byte and for the frame
+    functions the overhead per call on top of the cipher.
+*/
+TEST_CASE("crypto benchmark", "[al_crypto][benchmark]") {
+    // test key, the benchmark does not touch the keyring
+    const byte_t key[32] = {0};
+    mbedtls_aes_context aes_enc;
+    mbedtls_aes_context aes_dec;
+    mbedtls_gcm_context gcm;
+    byte_t* buffer = malloc(MAX_SIZE + 2 * (AL_CRYPTO_FRAME_LENGTH + 1));
+    byte_t* frame = buffer + MAX_SIZE;
+    byte_t* copy = frame + AL_CRYPTO_FRAME_LENGTH + 1;
+    // time per call of the raw configured mode by size
+    double raw_us[2][NUM_SIZES];
+    int64_t time_us;
+    int iterations;
+
+    TEST_ASSERT_NOT_NULL(buffer);
+    test_al_crypto_setup();
+    ESP_LOGI(TAG, "benchmark started");
+
+    mbedtls_aes_init(&aes_enc);
+    mbedtls_aes_setkey_enc(&aes_enc, key, 256);
+    mbedtls_aes_init(&aes_dec);
+    mbedtls_aes_setkey_dec(&aes_dec, key, 256);
+    mbedtls_gcm_init(&gcm);
+    mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 256);
+    memset(buffer, 'x', MAX_SIZE);
+
+    // raw ciphers of both modes
+    for (op_t op = OP_ENCRYPT; op <= OP_DECRYPT; ++op) {
+        for (int s = 0; s < NUM_SIZES; ++s) {
+            iterations = get_iterations(sizes[s]);
+
+            time_us = time_cbc((op == OP_ENCRYPT) ? &aes_enc : &aes_dec,
+                               op, buffer, sizes[s], iterations);
+            print_result("cbc", op, "raw", sizes[s], iterations, time_us, 0);
+#ifndef CONFIG_AES_256_MODE_GCM
+            raw_us[op][s] = (double)time_us / iterations;
+#endif
+
+            time_us = time_gcm(&gcm, op, buffer, sizes[s], iterations);
+            print_result("gcm", op, "raw", sizes[s], iterations, time_us, 0);
+#ifdef CONFIG_AES_256_MODE_GCM
+            raw_us[op][s] = (double)time_us / iterations;
+#endif
+        }
+    }
+
+    // frame functions of the configured mode, which include
+    // the nonce, the padding and the locks
+    for (op_t op = OP_ENCRYPT; op <= OP_DECRYPT; ++op) {
+        for (int s = 0; s < NUM_SIZES && sizes[s] <= AL_CRYPTO_MESSAGE_LENGTH; ++s) {
+            iterations = get_iterations(sizes[s]);
+            time_us = time_frame(op, frame, copy, sizes[s], iterations);
+#ifdef CONFIG_AES_256_MODE_GCM
+            print_result("gcm", op, "frame", sizes[s], iterations, time_us, raw_us[op][s]);
+#else
+            // a CBC frame is always padded to the maximum
+            print_result("cbc", op, "frame", sizes[s], iterations, time_us,
+                         raw_us[op][NUM_SIZES - 1] * AL_CRYPTO_MESSAGE_LENGTH / MAX_SIZE);
+#endif
+        }
+    }
+
+    mbedtls_aes_free(&aes_enc);
+    mbedtls_aes_free(&aes_dec);
+    mbedtls_gcm_free(&gcm);
+    free(buffer);
+
+    ESP_LOGI(TAG, "benchmark finished");
+}
@@ -0,0 +1,249 @@
+// APPLICATION LAYER
+// Source file of the Statistics component.
+
+#include "./al_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "../general/general.h"
+
+static const char *TAG = "al_stats";
+
+// PRIVATE FUNCTIONS
+
+// index of a sequence number in the ring buffers
+#define RING_INDEX(seq) ((seq) % AL_STATS_CAPACITY)
+
+/** Push a sample to the back of a monotonic deque.
+
+**Parameters**
+    - *deque : the min or max deque of a window
+    - *samples : ring buffer of the samples
+    - seq : sequence number of the new sample
+    - sign : +1 for the min deque, -1 for the max deque
+
+**Description**
+    Drop all samples from the back that can never become the
+    extremum again because the new sample is better, then
+    append the new sample. The front is always the extremum
+    of the window.
+*/
+void deque_push(al_stats_deque_t *deque,
+                al_stats_sample_t *samples,
+                uint32_t seq,
+                float sign) {
+    float value = sign * samples[RING_INDEX(seq)].value;
+
+    while (deque->tail != deque->head &&
+           sign * samples[RING_INDEX(deque->seq[RING_INDEX(deque->tail - 1)])].value >= value) {
+        deque->tail--;
+    }
+    deque->seq[RING_INDEX(deque->tail)] = seq;
+    deque->tail++;
+}
+
+/** Pop samples older than first from the front of a deque.
+
+**Parameters**
+    - *deque : the min or max deque of a window
+    - first : sequence number of the oldest sample in the
+        window
+*/
+void deque_evict(al_stats_deque_t *deque, uint32_t first) {
+    while (deque->tail != deque->head &&
+           (int32_t)(deque->seq[RING_INDEX(deque->head)] - first) < 0) {
+        deque->head++;
+    }
+}
+
+/** Add a sample to the accumulators of a window.
+
+**Description**
+    Welford update of the mean and the sum of squared
+    deviations of value and time and the co-moment of both.
+*/
+void window_add(al_stats_window_t *window, double t, double x) {
+    double dx, dt;
+
+    window->count++;
+    dt = t - window->mean_t;
+    dx = x - window->mean;
+    window->mean_t += dt / window->count;
+    window->mean += dx / window->count;
+    window->m2_t += dt * (t - window->mean_t);
+    window->m2 += dx * (x - window->mean);
+    window->c_tv += dt * (x - window->mean);
+}
+
+/** Remove a sample from the accumulators of a window.
+
+**Description**
+    Inverse of `window_add`. Reset the accumulators if the
+    window gets empty to not carry rounding errors.
+*/
+void window_remove(al_stats_window_t *window, double t, double x) {
+    double mean_old = window->mean;
+    double mean_t_old = window->mean_t;
+
+    if (window->count <= 1) {
+        window->count = 0;
+        window->mean = 0;
+        window->m2 = 0;
+        window->mean_t = 0;
+        window->m2_t = 0;
+        window->c_tv = 0;
+        return;
+    }
+
+    window->count--;
+    window->mean -= (x - window->mean) / window->count;
+    window->mean_t -= (t - window->mean_t) / window->count;
+    window->m2 -= (x - window->mean) * (x - mean_old);
+    window->m2_t -= (t - window->mean_t) * (t - mean_t_old);
+    window->c_tv -= (t - window->mean_t) * (x - mean_old);
+}
+
+/** Evict the samples that are no longer inside a window.
+
+**Parameters**
+    - *stats : statistics object
+    - *window : window to update
+    - now : current monotonic time in microseconds
+    - end : sequence number behind the samples that must fit
+        in the ring buffer
+
+**Description**
+    A sample is evicted if it is older than the window
+    length or if its slot in the ring buffer is needed up
+    to `end`. Evict before a slot is overwritten, the
+    accumulators need the old value. The time of a sample
+    evicted for room is kept in `covered`.
+*/
+void window_evict(al_stats_t *stats,
+                  al_stats_window_t *window,
+                  int64_t now,
+                  uint32_t end) {
+    int64_t oldest = now - (int64_t)window->length * 1000000;
+    al_stats_sample_t *sample;
+
+    while (window->first != stats->next) {
+        sample = &stats->samples[RING_INDEX(window->first)];
+        if (sample->time >= oldest &&
+            end - window->first <= AL_STATS_CAPACITY) {
+            break;
+        }
+        if (sample->time >= oldest) {
+            window->covered = sample->time;
+        }
+        window_remove(window,
+                      (double)sample->time / 1000000,
+                      sample->value);
+        window->first++;
+    }
+
+    deque_evict(&window->min, window->first);
+    deque_evict(&window->max, window->first);
+}
+
+// PUBLIC FUNCTIONS
+
+void al_stats_init(al_stats_t *stats) {
+    const uint32_t lengths[AL_STATS_NUM_WINDOWS] = AL_STATS_WINDOWS;
+
+    memset(stats, 0, sizeof(al_stats_t));
+    for (int i = 0; i < AL_STATS_NUM_WINDOWS; i++) {
+        stats->windows[i].length = lengths[i];
+        stats->windows[i].covered = INT64_MIN;
+    }
+
+    ESP_LOGV(TAG, "init with %d windows", AL_STATS_NUM_WINDOWS);
+}
+
+void al_stats_add(al_stats_t *stats, int64_t time, float value) {
+    uint32_t seq = stats->next;
+    al_stats_window_t *window;
+
+    // free the slot of the new sample in every window before
+    // it is overwritten
+    for (int i = 0; i < AL_STATS_NUM_WINDOWS; i++) {
+        window_evict(stats, &stats->windows[i], time, seq + 1);
+    }
+
+    stats->samples[RING_INDEX(seq)].time = time;
+    stats->samples[RING_INDEX(seq)].value = value;
+    stats->next++;
+
+    for (int i = 0; i < AL_STATS_NUM_WINDOWS; i++) {
+        window = &stats->windows[i];
+        window_add(window, (double)time / 1000000, value);
+        deque_push(&window->min, stats->samples, seq, 1);
+        deque_push(&window->max, stats->samples, seq, -1);
+    }
+}
+
+esp_err_t al_stats_query(al_stats_t *stats,
+                         al_stats_aggregate_t aggregate,
+                         uint32_t window_length,
+                         int64_t now,
+                         al_stats_result_t *result) {
+    al_stats_window_t *window = &stats->windows[AL_STATS_NUM_WINDOWS - 1];
+    int64_t oldest;
+
+    // pick the smallest window covering the request
+    for (int i = 0; i < AL_STATS_NUM_WINDOWS; i++) {
+        if (stats->windows[i].length >= window_length) {
+            window = &stats->windows[i];
+            break;
+        }
+    }
+
+    window_evict(stats, window, now, stats->next);
+    oldest = now - (int64_t)window->length * 1000000;
+    result->window = window->length;
+    if (window->covered > oldest) {
+        // samples inside the window were dropped for room
+        result->window = (now - window->covered) / 1000000;
+    }
+    result->count = window->count;
+    result->value = 0;
+
+    if (window->count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    switch (aggregate) {
+        case AL_STATS_MEAN:
+            result->value = window->mean;
+            break;
+
+        case AL_STATS_MIN:
+            result->value = stats->samples[RING_INDEX(window->min.seq[RING_INDEX(window->min.head)])].value;
+            break;
+
+        case AL_STATS_MAX:
+            result->value = stats->samples[RING_INDEX(window->max.seq[RING_INDEX(window->max.head)])].value;
+            break;
+
+        case AL_STATS_STDDEV:
+            if (window->count < 2) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            // sample standard deviation
+            result->value = sqrt(fmax(window->m2, 0) / (window->count - 1));
+            break;
+
+        case AL_STATS_SLOPE:
+            if (window->count < 2 || window->m2_t <= 0) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            // least squares slope of value over time
+            result->value = window->c_tv / window->m2_t;
+            break;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,148 @@
+// APPLICATION LAYER
+// Header file of the Statistics component.
+
+#ifndef _AL_STATS_H_
+#define _AL_STATS_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// number of samples that are kept per quantity, this also
+// bounds the number of samples inside any window. must be a
+// power of two so the ring indices survive the wrap around.
+#define AL_STATS_CAPACITY 64
+// number of sliding windows tracked per quantity
+#define AL_STATS_NUM_WINDOWS 3
+// lengths of the tracked sliding windows in seconds
+#define AL_STATS_WINDOWS \
+    { 600, 3600, 86400 }
+
+// aggregates that can be queried
+typedef enum {
+    AL_STATS_INVALID,
+    AL_STATS_MEAN,
+    AL_STATS_MIN,
+    AL_STATS_MAX,
+    AL_STATS_STDDEV,
+    AL_STATS_SLOPE
+} al_stats_aggregate_t;
+
+// one sample of the stream
+typedef struct al_stats_sample_t {
+    // monotonic time stamp in microseconds
+    int64_t time;
+    float value;
+} al_stats_sample_t;
+
+// fixed size double ended queue of sample sequence numbers
+typedef struct al_stats_deque_t {
+    uint32_t seq[AL_STATS_CAPACITY];
+    uint32_t head;
+    uint32_t tail;
+} al_stats_deque_t;
+
+// accumulators of one sliding window
+typedef struct al_stats_window_t {
+    // length of the window in seconds
+    uint32_t length;
+    // sequence number of the oldest sample in the window
+    uint32_t first;
+    // time of the newest sample that was evicted because
+    // the ring buffer was full, the window only covers the
+    // time after it
+    int64_t covered;
+    uint32_t count;
+    // Welford accumulators of the value
+    double mean;
+    double m2;
+    // Welford accumulators of the time in seconds and the
+    // co-moment of time and value for the slope
+    double mean_t;
+    double m2_t;
+    double c_tv;
+    // monotonic deques for the sliding minimum and maximum
+    al_stats_deque_t min;
+    al_stats_deque_t max;
+} al_stats_window_t;
+
+// streaming statistics of one quantity
+typedef struct al_stats_t {
+    al_stats_sample_t samples[AL_STATS_CAPACITY];
+    // sequence number of the next sample
+    uint32_t next;
+    al_stats_window_t windows[AL_STATS_NUM_WINDOWS];
+} al_stats_t;
+
+// result of a query
+typedef struct al_stats_result_t {
+    double value;
+    // length of the window that answered the query in
+    // seconds, shorter if the ring buffer holds less
+    uint32_t window;
+    // number of samples inside the window
+    uint32_t count;
+} al_stats_result_t;
+
+/** Initialize the statistics of one quantity.
+
+**Parameters**
+    - *stats : statistics object to initialize
+
+**Description**
+    Clear all samples and set up the sliding windows with
+    the lengths from `AL_STATS_WINDOWS`.
+*/
+void al_stats_init(al_stats_t *stats);
+
+/** Add a sample to the stream.
+
+**Parameters**
+    - *stats : statistics object
+    - time : monotonic time stamp in microseconds
+    - value : value of the sample
+
+**Requirements**
+    Time stamps must not decrease between calls.
+
+**Description**
+    Store the sample in the ring buffer. Evict the samples
+    that fell out of each window and update the Welford
+    accumulators and the monotonic min/max deques. The cost
+    is amortized O(1) per window.
+*/
+void al_stats_add(al_stats_t *stats, int64_t time, float value);
+
+/** Query an aggregate over a sliding window.
+
+**Parameters**
+    - *stats : statistics object
+    - aggregate : the aggregate to evaluate
+    - window : requested window length in seconds
+    - now : current monotonic time in microseconds
+    - *result : output for the value, window and count
+
+**Return**
+    - err:
+        `ESP_ERR_INVALID_ARG` for an invalid aggregate,
+        `ESP_ERR_NOT_FOUND` if the window holds too few
+        samples and `ESP_OK` otherwise.
+
+**Description**
+    Use the smallest tracked window which is at least as
+    long as the requested one, or the longest window if
+    none is. Evict stale samples and evaluate the aggregate
+    in O(1) from the accumulators. The slope is given in
+    units per second. Because the ring buffer holds only
+    `AL_STATS_CAPACITY` samples a window may cover less
+    time than its length if the sampling is fast, then the
+    covered time is reported as `window` of the result.
+*/
+esp_err_t al_stats_query(al_stats_t *stats,
+                         al_stats_aggregate_t aggregate,
+                         uint32_t window,
+                         int64_t now,
+                         al_stats_result_t *result);
+
+#endif  // _AL_STATS_H_
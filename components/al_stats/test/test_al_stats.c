@@ -0,0 +1,167 @@
+// APPLICATION LAYER
+// Source file of the tests of the Statistics component.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "../al_stats.h"
+#include "unity.h"
+
+// relative tolerance of the accumulators against the
+// direct computation
+#define TOLERANCE 1e-6
+
+static const uint32_t lengths[AL_STATS_NUM_WINDOWS] = AL_STATS_WINDOWS;
+
+// PRIVATE FUNCTIONS
+
+/** Compare a value with the expected one */
+static bool is_close(double value, double expected) {
+    return fabs(value - expected) <= TOLERANCE * (1 + fabs(expected));
+}
+
+/** Next value of a reproducible pseudo random sequence */
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+/** Check all aggregates of all windows.
+
+**Parameters**
+    - *stats : statistics object under test
+    - now : time of the queries in microseconds
+
+**Return**
+    `true` if every aggregate matches the direct computation
+    over the samples that are still in the ring buffer.
+
+**Description**
+    The ring buffer itself is the reference, so a sample
+    that was evicted with a wrong value shows up as a
+    mismatch of the accumulators.
+*/
+static bool check_windows(al_stats_t *stats, int64_t now) {
+    const al_stats_aggregate_t aggregates[] = {
+        AL_STATS_MEAN, AL_STATS_MIN, AL_STATS_MAX, AL_STATS_STDDEV, AL_STATS_SLOPE};
+    uint32_t kept = (stats->next < AL_STATS_CAPACITY) ? stats->next : AL_STATS_CAPACITY;
+    al_stats_result_t result;
+    al_stats_sample_t *sample;
+    double expected[AL_STATS_SLOPE + 1];
+    double sum, sum_t, mean, mean_t, m2, m2_t, c_tv, t;
+    uint32_t count;
+
+    for (int w = 0; w < AL_STATS_NUM_WINDOWS; w++) {
+        count = 0;
+        sum = 0;
+        sum_t = 0;
+        expected[AL_STATS_MIN] = INFINITY;
+        expected[AL_STATS_MAX] = -INFINITY;
+        for (uint32_t seq = stats->next - kept; seq != stats->next; seq++) {
+            sample = &stats->samples[seq % AL_STATS_CAPACITY];
+            if (sample->time < now - (int64_t)lengths[w] * 1000000) {
+                continue;
+            }
+            count++;
+            sum += sample->value;
+            sum_t += (double)sample->time / 1000000;
+            expected[AL_STATS_MIN] = fmin(expected[AL_STATS_MIN], sample->value);
+            expected[AL_STATS_MAX] = fmax(expected[AL_STATS_MAX], sample->value);
+        }
+        if (count < 2) {
+            continue;
+        }
+
+        mean = sum / count;
+        mean_t = sum_t / count;
+        m2 = 0;
+        m2_t = 0;
+        c_tv = 0;
+        for (uint32_t seq = stats->next - kept; seq != stats->next; seq++) {
+            sample = &stats->samples[seq % AL_STATS_CAPACITY];
+            if (sample->time < now - (int64_t)lengths[w] * 1000000) {
+                continue;
+            }
+            t = (double)sample->time / 1000000;
+            m2 += (sample->value - mean) * (sample->value - mean);
+            m2_t += (t - mean_t) * (t - mean_t);
+            c_tv += (t - mean_t) * (sample->value - mean);
+        }
+        expected[AL_STATS_MEAN] = mean;
+        expected[AL_STATS_STDDEV] = sqrt(m2 / (count - 1));
+        expected[AL_STATS_SLOPE] = c_tv / m2_t;
+
+        for (int a = 0; a < sizeof(aggregates) / sizeof(aggregates[0]); a++) {
+            if (al_stats_query(stats, aggregates[a], lengths[w], now, &result) != ESP_OK ||
+                result.count != count ||
+                !is_close(result.value, expected[aggregates[a]])) {
+                printf("window %u aggregate %d: %f (%u samples), expected %f (%u samples)\n",
+                       lengths[w], aggregates[a], result.value, result.count,
+                       expected[aggregates[a]], count);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// TEST CASES
+
+/** Test the eviction when the ring buffer wraps around.
+
+**Description**
+    After 200 samples alternating between 10 and 20 and 200
+    samples of 100 every window holds only the last 64
+    samples of 100 and reports the time they cover.
+*/
+TEST_CASE("sliding windows after the ring buffer wrapped", "[al_stats]") {
+    static al_stats_t stats;
+    al_stats_result_t result;
+    int64_t time = 0;
+
+    al_stats_init(&stats);
+    for (int i = 0; i < 400; i++) {
+        time += 60 * 1000000LL;
+        al_stats_add(&stats, time, (i < 200) ? ((i % 2) ? 20 : 10) : 100);
+    }
+
+    for (int w = 0; w < AL_STATS_NUM_WINDOWS; w++) {
+        al_stats_query(&stats, AL_STATS_MEAN, lengths[w], time, &result);
+        TEST_ASSERT_EQUAL(lengths[w] / 60 < AL_STATS_CAPACITY ? lengths[w] / 60 + 1 : AL_STATS_CAPACITY,
+                          result.count);
+        TEST_ASSERT_TRUE(is_close(result.value, 100));
+        al_stats_query(&stats, AL_STATS_MIN, lengths[w], time, &result);
+        TEST_ASSERT_TRUE(is_close(result.value, 100));
+        al_stats_query(&stats, AL_STATS_MAX, lengths[w], time, &result);
+        TEST_ASSERT_TRUE(is_close(result.value, 100));
+    }
+    // the last 64 samples cover 64 minutes of the day
+    al_stats_query(&stats, AL_STATS_MEAN, 86400, time, &result);
+    TEST_ASSERT_EQUAL(64 * 60, result.window);
+
+    TEST_ASSERT_TRUE(check_windows(&stats, time));
+}
+
+/** Test random streams against the direct computation.
+
+**Description**
+    Vary the sampling period so the windows are bounded
+    by their length at times and by the ring buffer at
+    others, and check after every sample.
+*/
+TEST_CASE("sliding windows of a random stream", "[al_stats]") {
+    static al_stats_t stats;
+    uint32_t state = 1;
+    int64_t time = 0;
+
+    al_stats_init(&stats);
+    for (int i = 0; i < 1000; i++) {
+        // periods from 1 s up to about 2 h
+        time += (int64_t)(1 + next_random(&state) % ((i % 300 < 150) ? 60 : 7200)) * 1000000;
+        al_stats_add(&stats, time, (float)(next_random(&state) % 20000) / 100 - 50);
+        TEST_ASSERT_TRUE(check_windows(&stats, time));
+    }
+    // all samples age out of the windows
+    TEST_ASSERT_TRUE(check_windows(&stats, time + 2 * 86400 * 1000000LL));
+}
@@ -3,32 +3,164 @@
 
 #include "./al_weather_station.h"
 
+#include <stdarg.h>
 #include <string.h>
+#include <time.h>
 
 #include "../al_bmp180/al_bmp180.h"
-// #include "../al_crypto/al_crypto.h"
+#include "../al_crypto/al_crypto.h"
+#include "../al_stats/al_stats.h"
+#include "../arena/arena.h"
 #include "../general/general.h"
-#include "../heartbeat/heartbeat.h"
+#include "../metrics/metrics.h"
+#include "../pl_json/pl_json.h"
 #include "../pl_udp/pl_udp.h"
-#include "cJSON.h"
+#include "../registry/registry.h"
+#include "../scheduler/scheduler.h"
+#include "../timesync/timesync.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 typedef enum {
     INVALID_QUANTITY,
     TEMPERATURE,
-    PRESSURE
+    PRESSURE,
+    NUM_QUANTITIES
 } quantity_type_t;
 
+// bit of a quantity type in a request plan
+#define QUANTITY_BIT(quantity) (1 << (quantity))
+// plan with all quantities
+#define ALL_QUANTITIES (QUANTITY_BIT(TEMPERATURE) | QUANTITY_BIT(PRESSURE))
+
+// description of a quantity in the responses
+typedef struct quantity_info_t {
+    const char *name;
+    const char *unit;
+    // divisor from the BMP180 value to the unit
+    float scale;
+    // number of decimals of the value
+    int precision;
+} quantity_info_t;
+
+// last converted sample of a quantity
+typedef struct sample_t {
+    int32_t value;
+    // monotonic time of the conversion in microseconds,
+    // converted to wall clock time when it is sent
+    int64_t time;
+    bool valid;
+} sample_t;
+
+// length of the response buffers in bytes, a reply to a
+// request may span several fragments
+#define REPLY_LENGTH 1024
+#define RESPONSE_LENGTH 256
+// length of a formatted time string in bytes
+#define TIME_LENGTH 32
+
+// sizes of the arenas of the two tasks that assemble
+// responses, the event loop answering requests and the
+// scheduler job sending measurements
+#define REQUEST_ARENA_SIZE 2048
+#define MEASUREMENT_ARENA_SIZE 512
+
+// response that is assembled by the request handlers
+typedef struct response_t {
+    // arena holding the buffer and scratch memory
+    arena_t *arena;
+    char *buffer;
+    // size of the buffer, 0 if it could not be allocated
+    int size;
+    // number of characters written, may exceed the buffer
+    // length on overflow
+    int len;
+    // message that is answered, NULL for a measurement
+    const pl_udp_message_t *request;
+} response_t;
+
+// maximum number of JSON tokens of a received message
+#define MAX_TOKENS 64
+
+// fields of a request, see `request_keys`
 typedef enum {
-    INVALID_NAME,
-    HEARTBEAT,
-    HEARTBEAT_INTERVAL,
-    MEASUREMENT_INTERVAL
-} name_type_t;
+    FIELD_TYPE,
+    FIELD_ID,
+    FIELD_QUANTITY,
+    FIELD_AGGREGATE,
+    FIELD_WINDOW,
+    FIELD_MAX_AGE,
+    FIELD_NAME,
+    FIELD_VALUE,
+    NUM_FIELDS
+} field_t;
+
+// typed view on one request object of a parsed message
+typedef struct request_t {
+    pl_json_t *doc;
+    // token index of each field or -1 if it is missing
+    int fields[NUM_FIELDS];
+} request_t;
 
 static const char *TAG = "weather_station";
 
-// handle to identify the timer
-esp_timer_handle_t measurement_timer;
+// handle of the job in the scheduler
+int measurement_job;
+
+// period of the measurement job in seconds
+uint64_t measurement_period = 600;
+
+static const quantity_info_t quantity_info[NUM_QUANTITIES] = {
+    [TEMPERATURE] = {"temperature", "celsius", 10, 1},
+    [PRESSURE] = {"pressure", "hPa", 100, 3}};
+
+// keys of the fields of a request
+static const char *const request_keys[NUM_FIELDS] = {
+    [FIELD_TYPE] = "type",
+    [FIELD_ID] = "id",
+    [FIELD_QUANTITY] = "quantity",
+    [FIELD_AGGREGATE] = "aggregate",
+    [FIELD_WINDOW] = "window",
+    [FIELD_MAX_AGE] = "max_age",
+    [FIELD_NAME] = "name",
+    [FIELD_VALUE] = "value"};
+
+// all memory of a request, the tokens, the response and
+// the time strings, comes from the arena of its task which
+// is reset after the reply was sent. so the heap is not
+// touched per message.
+static uint8_t request_block[REQUEST_ARENA_SIZE];
+static arena_t request_arena;
+static uint8_t measurement_block[MEASUREMENT_ARENA_SIZE];
+static arena_t measurement_arena;
+
+// streaming statistics of the sampled quantities, fed only
+// by the measurement job so fast polling does not flush the
+// history. guarded by `stats_lock` because the timer and
+// the event loop run in different tasks
+static al_stats_t stats[NUM_QUANTITIES];
+SemaphoreHandle_t stats_lock;
+
+// cache of the last conversion of each quantity. a
+// conversion on the BMP180 is only done while holding
+// `conversion_lock`, so requests arriving during a
+// conversion wait for it and share its result.
+static sample_t cache[NUM_QUANTITIES];
+SemaphoreHandle_t conversion_lock;
+
+// number of scheduled measurements that are held before
+// the first time synchronization
+#define HELD_MEASUREMENTS 4
+
+// ring of the scheduled measurements before the first time
+// synchronization, sent once their time is known. the
+// oldest one is overwritten when the ring is full. guarded
+// by `conversion_lock` as well.
+static sample_t held[HELD_MEASUREMENTS][NUM_QUANTITIES];
+static int num_held = 0;
+static int next_held = 0;
+// measurements that were overwritten since the boot
+static uint32_t num_held_dropped = 0;
 
 // PRIVATE FUNCTIONS
 
@@ -60,7 +192,7 @@ uint8_t string2quanity_type(char *string) {
     return quantity_type;
 }
 
-/** Convert a string to a name_type number.
+/** Convert a string to an aggregate type.
 
 ** Parameters**
     - string:
@@ -68,168 +200,895 @@ uint8_t string2quanity_type(char *string) {
         converted
 
 **Return**
-    A numerical value of the enum `quantity_name_t` is
+    A numerical value of the enum `al_stats_aggregate_t` is
     returned depending on the input string. The standard
-    value if no string is matched is `INVALID_NAME`.
+    value if no string is matched is `AL_STATS_INVALID`.
 
 **Description**
     Use `strcmp` to check the input string against known
     types.
 */
-uint8_t string2name_type(char *string) {
-    name_type_t name_type = INVALID_NAME;
+uint8_t string2aggregate_type(char *string) {
+    al_stats_aggregate_t aggregate_type = AL_STATS_INVALID;
 
-    if (0 == strcmp(string, "heartbeat")) {
-        name_type = HEARTBEAT;
-    } else if (0 == strcmp(string, "heartbeat_interval")) {
-        name_type = HEARTBEAT_INTERVAL;
-    } else if (0 == strcmp(string, "measurement_interval")) {
-        name_type = MEASUREMENT_INTERVAL;
+    if (0 == strcmp(string, "mean")) {
+        aggregate_type = AL_STATS_MEAN;
+    } else if (0 == strcmp(string, "min")) {
+        aggregate_type = AL_STATS_MIN;
+    } else if (0 == strcmp(string, "max")) {
+        aggregate_type = AL_STATS_MAX;
+    } else if (0 == strcmp(string, "stddev")) {
+        aggregate_type = AL_STATS_STDDEV;
+    } else if (0 == strcmp(string, "slope")) {
+        aggregate_type = AL_STATS_SLOPE;
     }
 
-    return name_type;
+    return aggregate_type;
 }
 
-/** Do the measurement of the specified quantity.
+/** Add a sample to the streaming statistics.
 
 **Parameters**
-    - quantity_string:
-        char pointer to the string that can be converted to
-        a quantity type by `string2quantity_type`
+    - quantity : the sampled quantity type
+    - time : monotonic time of the sample in microseconds
+    - value : value in the unit of the response
 
 **Description**
-    Start issuing the measurment on the BMP180. This include
-    the temperature and the pressure. Get the system time
-    and send the result of the measurement together with the
-    time stamp via UDP. If the input string does not match
-    send an error.
+    Add the sample to the statistics while holding the lock.
 */
-void make_measurement(char *quantity_string) {
-    char time_buf[32];
-    char tx_buffer[256];
-    int32_t quantity_value;
+void record_sample(quantity_type_t quantity, int64_t time, float value) {
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    al_stats_add(&stats[quantity], time, value);
+    xSemaphoreGive(stats_lock);
+}
 
-    switch (string2quanity_type(quantity_string)) {
-        case TEMPERATURE:
-            quantity_value = al_bmp180_get_temperature();
-            get_time(time_buf);
+/** Convert the quantities of a plan on the BMP180.
 
-            sprintf(tx_buffer,
-                    "{\"type\":\"response\",\"time\":\"%s\",\"quantity\":"
-                    "[{\"name\":\"temperature\",\"value\": %.1f,\"unit\":\"celsius\"}]}",
-                    time_buf, (float)quantity_value / 10);
-            pl_udp_send(tx_buffer);
-            break;
+**Parameters**
+    - plan:
+        bit mask of `QUANTITY_BIT` of the quantities to
+        convert
+    - oss:
+        oversampling setting of a pressure conversion
 
-        case PRESSURE:
-            quantity_value = al_bmp180_get_pressure(1);
-            get_time(time_buf);
+**Requirements**
+    The caller must hold `conversion_lock`.
 
-            sprintf(tx_buffer,
-                    "{\"type\":\"response\",\"time\":\"%s\",\"quantity\":"
-                    "[{\"name\":\"pressure\",\"value\": %.3f,\"unit\":\"hPa\"}]}",
-                    time_buf, (float)quantity_value / 100);
-            pl_udp_send(tx_buffer);
-            break;
+**Description**
+    A pressure conversion always needs a temperature
+    conversion for the compensation, so it refreshes both
+    quantities with a single temperature conversion. Store
+    the new values together with the monotonic time of the
+    conversion in the cache.
+*/
+void convert_quantities(uint8_t plan, uint8_t oss) {
+    int64_t start = esp_timer_get_time();
+    int32_t t, p;
+    int64_t now;
 
-        default:
-            pl_udp_send("{\"type\":\"error\"}");
-            break;
+    if (plan & QUANTITY_BIT(PRESSURE)) {
+        al_bmp180_get_temperature_pressure(oss, &t, &p);
+        plan |= QUANTITY_BIT(TEMPERATURE);
+    } else if (plan & QUANTITY_BIT(TEMPERATURE)) {
+        t = al_bmp180_get_temperature();
+    } else {
+        return;
+    }
+
+    now = esp_timer_get_time();
+    metrics_record(METRICS_CONVERSION, now - start);
+    cache[TEMPERATURE].value = t;
+    if (plan & QUANTITY_BIT(PRESSURE)) {
+        cache[PRESSURE].value = p;
+    }
+
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if (plan & QUANTITY_BIT(q)) {
+            cache[q].time = now;
+            cache[q].valid = true;
+        }
     }
 }
 
-/** Set the variable to the given value of type string.
+/** Get samples of the quantities of a plan.
 
 **Parameters**
-    - name_string:
-        string that contains the name of the variable to be
-        set. This must be convertable by `string2name_type`
-    - value_string:
-        string containing the value for the set variable
+    - plan:
+        bit mask of `QUANTITY_BIT` of the quantities
+    - max_age:
+        maximum age of a cached sample in seconds
+    - oss:
+        oversampling setting of a pressure conversion
+    - *samples:
+        output array of `NUM_QUANTITIES` samples, only the
+        entries of the plan are written
 
 **Description**
-    Convert name_string to a `name_type_t`. Handle the cases
-    from there. Turn the heartbeat `on` or `off` with this.
+    Wait for a conversion in flight. Every cached sample
+    that is younger than `max_age` or was converted while
+    waiting is used. Only the remaining quantities are
+    converted, with a single shared conversion.
 */
-void set_variable_string(char *name_string,
-                         char *value_string) {
-    switch (string2name_type(name_string)) {
-        case HEARTBEAT:
-            if (0 == strcmp(value_string, "on")) {
-                heartbeat_start();
-            } else if (0 == strcmp(value_string, "off")) {
-                heartbeat_stop();
+void get_samples(uint8_t plan,
+                 uint32_t max_age,
+                 uint8_t oss,
+                 sample_t *samples) {
+    int64_t requested = esp_timer_get_time();
+    uint8_t stale = 0;
+
+    xSemaphoreTake(conversion_lock, portMAX_DELAY);
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if ((plan & QUANTITY_BIT(q)) &&
+            !(cache[q].valid &&
+              (cache[q].time >= requested ||
+               requested - cache[q].time <= (int64_t)max_age * 1000000))) {
+            stale |= QUANTITY_BIT(q);
+        }
+    }
+    ESP_LOGD(TAG, "plan 0x%02x, converting 0x%02x", plan, stale);
+
+    convert_quantities(stale, oss);
+
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if (plan & QUANTITY_BIT(q)) {
+            samples[q] = cache[q];
+        }
+    }
+    xSemaphoreGive(conversion_lock);
+}
+
+/** Plan the quantities of a get request.
+
+**Parameters**
+    - *request:
+        the request whose `quantity` field is a string or an
+        array of strings
+
+**Return**
+    Bit mask of `QUANTITY_BIT` of the requested quantities.
+    Duplicates are collapsed and unknown names are ignored.
+*/
+uint8_t plan_quantities(const request_t *request) {
+    pl_json_t *doc = request->doc;
+    int quantity = request->fields[FIELD_QUANTITY];
+    uint8_t plan = 0;
+    int element;
+
+    if (pl_json_is(doc, quantity, PL_JSON_STRING)) {
+        plan = QUANTITY_BIT(string2quanity_type(pl_json_string(doc, quantity)));
+    } else if (pl_json_is(doc, quantity, PL_JSON_ARRAY)) {
+        element = quantity + 1;
+        for (int k = 0; k < doc->tokens[quantity].size; k++) {
+            if (pl_json_is(doc, element, PL_JSON_STRING)) {
+                plan |= QUANTITY_BIT(string2quanity_type(pl_json_string(doc, element)));
             }
-            break;
+            element = pl_json_next(doc, element);
+        }
+    }
+
+    // drop the bit of unknown quantities
+    return plan & ~QUANTITY_BIT(INVALID_QUANTITY);
+}
+
+/** Get an optional integer field of a request.
 
-        default:
-            break;
+**Parameters**
+    - *request : the request
+    - field : the field to read
+    - fallback : value if the field is missing or invalid
+
+**Return**
+    The value of the field or the fallback.
+*/
+int32_t request_int(const request_t *request, field_t field, int32_t fallback) {
+    int32_t value;
+
+    if (pl_json_int(request->doc, request->fields[field], &value)) {
+        return value;
     }
+    return fallback;
 }
 
-/** Set the variable to the given value of type int.
+/** Start an empty response.
 
 **Parameters**
-    - name_string:
-        string that contains the name of the variable to be
-        set. This must be convertable by `string2name_type`
-    - value_int:
-        integer containing the value for the set variable
+    - *response : the response
+    - *arena : arena of the calling task
+    - size : size of the buffer
 
 **Description**
-    Convert name_string to a `name_type_t`. Handle the cases
-    from there. Set the time intervals of the heartbeat and
-    measurement timers with this.
+    Allocate the buffer from the arena. If that fails the
+    response is overflowed from the start.
 */
-void set_variable_int(char *name_string,
-                      uint64_t value_int) {
-    switch (string2name_type(name_string)) {
-        case HEARTBEAT_INTERVAL:
-            // restart the heartbeat timer with the new
-            // period
-            heartbeat_stop();
-            heartbeat_set_period(value_int);
-            heartbeat_start();
-            ESP_LOGI(TAG, "Updated heartbeat period to %llu seconds.", value_int);
-            break;
+void response_init(response_t *response, arena_t *arena, int size) {
+    response->arena = arena;
+    response->buffer = arena_alloc(arena, size);
+    response->size = (response->buffer != NULL) ? size : 0;
+    response->len = 0;
+    response->request = NULL;
+}
+
+/** Allocate scratch memory for a response.
+
+**Parameters**
+    - *response : the response
+    - size : number of bytes
+
+**Return**
+    Pointer to the memory or NULL if the arena is exhausted.
 
-        case MEASUREMENT_INTERVAL:
-            // restart the measurement time with the new
-            // period
-            al_weather_station_stop();
-            al_weather_station_start(value_int);
-            ESP_LOGI(TAG, "Updated measurement period to %llu seconds.", value_int);
-            break;
+**Description**
+    The memory lives until the arena is reset after the
+    response was sent. On failure the response is marked as
+    overflowed so an error is sent instead.
+*/
+char *response_alloc(response_t *response, int size) {
+    char *memory = arena_alloc(response->arena, size);
 
-        default:
-            break;
+    if (memory == NULL) {
+        response->len = response->size;
     }
+    return memory;
 }
 
-/** Function gets called when the timer runs out.
+/** Append formatted text to a response.
+
+**Parameters**
+    - *response : the response to append to
+    - *format : printf like format string
+
+**Description**
+    Append with `vsnprintf`. Once the buffer overflowed the
+    response stays invalid and nothing more is appended.
+*/
+void response_append(response_t *response, const char *format, ...) {
+    va_list args;
+
+    if (response->len >= response->size) {
+        return;
+    }
+
+    va_start(args, format);
+    response->len += vsnprintf(response->buffer + response->len,
+                               response->size - response->len,
+                               format,
+                               args);
+    va_end(args);
+}
+
+/** Close a list in a response.
+
+**Parameters**
+    - *response : the response to append to
+    - *closing : closing characters, e.g. `]}`
+
+**Description**
+    Drop the trailing comma of the last list element and
+    append the closing characters.
+*/
+void response_close(response_t *response, const char *closing) {
+    if (response->len > 0 &&
+        response->len < response->size &&
+        response->buffer[response->len - 1] == ',') {
+        response->len--;
+    }
+    response_append(response, "%s", closing);
+}
+
+/** Start a reply object in a response.
+
+**Parameters**
+    - *response : the response to append to
+    - *type : value of the `type` field
+    - *request : the request that is answered or NULL
+
+**Description**
+    Open the JSON object with the type and echo the `id` of
+    the request so clients can correlate the reply. The
+    object is left open for more fields.
+*/
+void response_begin(response_t *response, const char *type, const request_t *request) {
+    int32_t id_int;
+    int id;
+
+    response_append(response, "{\"type\":\"%s\"", type);
+    if (request == NULL) {
+        return;
+    }
+
+    id = request->fields[FIELD_ID];
+    if (pl_json_int(request->doc, id, &id_int)) {
+        response_append(response, ",\"id\":%d", id_int);
+    } else if (pl_json_is(request->doc, id, PL_JSON_STRING)) {
+        response_append(response, ",\"id\":\"%s\"", pl_json_string(request->doc, id));
+    }
+}
+
+/** Send a response via UDP.
+
+**Parameters**
+    - *response : the assembled response
+
+**Description**
+    Send the response, as a reply to its request if it has
+    one. If it overflowed the buffer send an error instead.
+*/
+void response_send(response_t *response) {
+    if (response->len >= response->size) {
+        ESP_LOGW(TAG,
+                 "response of %d bytes does not fit the buffer of %d bytes",
+                 response->len,
+                 response->size);
+        pl_udp_reply(response->request, "{\"type\":\"error\",\"error\":\"overflow\"}");
+    } else {
+        pl_udp_reply(response->request, response->buffer);
+    }
+}
+
+/** Append a timestamp to a response.
+
+**Parameters**
+    - *response : the response to append to
+    - *time_buf : buffer of `TIME_LENGTH` bytes
+    - monotonic : time of `esp_timer_get_time`
+
+**Description**
+    Convert the monotonic time to wall clock time now, so
+    a sample taken before the time synchronization gets
+    the right time once it is known. If the time is not
+    synchronized or a correction is slewed the quality is
+    added as `time_quality`.
+*/
+void append_time(response_t *response, char *time_buf, int64_t monotonic) {
+    time_quality_t quality = get_time_quality();
+
+    format_time_us(monotonic_to_epoch_us(monotonic), 0, time_buf);
+    response_append(response, ",\"time\":\"%s\"", time_buf);
+    if (quality != TIME_SYNCED) {
+        response_append(response, ",\"time_quality\":\"%s\"",
+                        (quality == TIME_UNSYNCED) ? "unsynced" : "slewing");
+    }
+}
+
+/** Append the samples of a plan to a response.
+
+**Parameters**
+    - *response : the response to append to
+    - *type : value of the `type` field of the reply
+    - *request : the request that is answered or NULL
+    - plan : bit mask of `QUANTITY_BIT` of the quantities
+    - *samples : array of `NUM_QUANTITIES` samples
+
+**Description**
+    List all quantities of the plan in one JSON object. The
+    time of the reply is the time of the oldest sample.
+*/
+void append_samples(response_t *response,
+                    const char *type,
+                    const request_t *request,
+                    uint8_t plan,
+                    sample_t *samples) {
+    char *time_buf = response_alloc(response, TIME_LENGTH);
+    int64_t oldest = INT64_MAX;
+
+    if (time_buf == NULL) {
+        return;
+    }
+
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if ((plan & QUANTITY_BIT(q)) && samples[q].time < oldest) {
+            oldest = samples[q].time;
+        }
+    }
+
+    response_begin(response, type, request);
+    append_time(response, time_buf, oldest);
+    response_append(response, ",\"quantity\":[");
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if (plan & QUANTITY_BIT(q)) {
+            response_append(response,
+                            "{\"name\":\"%s\",\"value\": %.*f,\"unit\":\"%s\"},",
+                            quantity_info[q].name,
+                            quantity_info[q].precision,
+                            (float)samples[q].value / quantity_info[q].scale,
+                            quantity_info[q].unit);
+        }
+    }
+    response_close(response, "]}");
+}
+
+/** Do the measurement of the planned quantities.
+
+**Parameters**
+    - *response : the response to append the reply to
+    - *request : the request that is answered or NULL
+    - plan:
+        bit mask of `QUANTITY_BIT` of the requested
+        quantities
+    - max_age:
+        maximum age in seconds of a cached sample that can
+        be used instead of a new measurement
+
+**Return**
+    - err: `ESP_ERR_INVALID_ARG` if no known quantity or a
+        negative maximum age was requested and `ESP_OK`
+        otherwise
+
+**Description**
+    Get samples of the quantities which are at most
+    `max_age` old with the minimum number of conversions,
+    see `get_samples`. Append all of them in one reply.
+*/
+esp_err_t make_measurement(response_t *response,
+                           const request_t *request,
+                           uint8_t plan,
+                           int32_t max_age) {
+    sample_t samples[NUM_QUANTITIES];
+
+    // a negative age would wrap around to a huge one
+    if (plan == 0 || max_age < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    get_samples(plan, max_age, 1, samples);
+    append_samples(response, "response", request, plan, samples);
+    return ESP_OK;
+}
+
+/** Answer an aggregate query from the streaming statistics.
+
+**Parameters**
+    - *response : the response to append the reply to
+    - *request : the request that is answered or NULL
+    - plan:
+        bit mask of `QUANTITY_BIT` of the requested
+        quantities
+    - aggregate_string:
+        char pointer to the string that can be converted to
+        an aggregate type by `string2aggregate_type`
+    - window:
+        requested window length in seconds
+
+**Return**
+    - err: `ESP_ERR_INVALID_ARG` if no known quantity, an
+        unknown aggregate or a negative window was
+        requested, `ESP_ERR_NOT_FOUND` if no quantity could
+        be answered and `ESP_OK` otherwise
+
+**Description**
+    Evaluate the aggregate over the sampled stream without
+    starting a new conversion on the BMP180. Append the
+    values in one reply together with the window and the
+    number of samples each is based on. The slope is given
+    per hour. Quantities whose window holds too few samples
+    are left out. If nothing is left the reply is removed
+    again.
+*/
+esp_err_t make_aggregate(response_t *response,
+                         const request_t *request,
+                         uint8_t plan,
+                         char *aggregate_string,
+                         int32_t window) {
+    al_stats_aggregate_t aggregate = string2aggregate_type(aggregate_string);
+    al_stats_result_t result;
+    int64_t now = esp_timer_get_time();
+    int start = response->len;
+    int num_results = 0;
+    char *time_buf;
+    esp_err_t err;
+
+    // a bad request is no missing data, a negative window
+    // would wrap around to a huge one
+    if (plan == 0 || aggregate == AL_STATS_INVALID || window < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    time_buf = response_alloc(response, TIME_LENGTH);
+    if (time_buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    response_begin(response, "response", request);
+    append_time(response, time_buf, now);
+    response_append(response,
+                    ",\"aggregate\":\"%s\",\"window\":%d,\"quantity\":[",
+                    aggregate_string, window);
+
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        if (!(plan & QUANTITY_BIT(q))) {
+            continue;
+        }
+
+        xSemaphoreTake(stats_lock, portMAX_DELAY);
+        err = al_stats_query(&stats[q], aggregate, window, now, &result);
+        xSemaphoreGive(stats_lock);
+
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "aggregate %s of %s failed: %s",
+                     aggregate_string, quantity_info[q].name, esp_err_to_name(err));
+            continue;
+        }
+
+        if (aggregate == AL_STATS_SLOPE) {
+            result.value *= 3600;
+        }
+
+        response_append(response,
+                        "{\"name\":\"%s\",\"window\":%u,\"count\":%u,"
+                        "\"value\": %.3f,\"unit\":\"%s%s\"},",
+                        quantity_info[q].name, result.window, result.count,
+                        result.value, quantity_info[q].unit,
+                        (aggregate == AL_STATS_SLOPE) ? "/h" : "");
+        num_results++;
+    }
+    response_close(response, "]}");
+
+    if (num_results == 0 && response->len < response->size) {
+        // roll back the reply
+        response->len = start;
+        response->buffer[start] = '\0';
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+/** Append all registered variables to a response.
+
+**Parameters**
+    - *response : the response to append the reply to
+    - *request : the request that is answered
+
+**Description**
+    Map the name of every readable variable in the registry
+    to its current value. Units are left out to fit the reply into
+    one datagram.
+*/
+void append_config(response_t *response, const request_t *request) {
+    const registry_entry_t *entry;
+    int32_t value;
+
+    response_begin(response, "response", request);
+    response_append(response, ",\"config\":{");
+    for (int k = 0; (entry = registry_get(k)) != NULL; k++) {
+        if (entry->get == NULL) {
+            // write only
+            continue;
+        }
+        value = entry->get();
+        if (entry->type == REGISTRY_BOOL) {
+            response_append(response, "\"%s\":\"%s\",", entry->name, value ? "on" : "off");
+        } else {
+            response_append(response, "\"%s\":%d,", entry->name, value);
+        }
+    }
+    response_close(response, "}}");
+}
+
+/** Append the latency percentiles of all stages.
+
+**Parameters**
+    - *response : the response to append to
+    - *request : the request that is answered
+
+**Description**
+    Map the name of every stage to its count and its p50,
+    p90, p99 and maximum duration in microseconds.
+*/
+void append_metrics(response_t *response, const request_t *request) {
+    metrics_summary_t summary;
+
+    response_begin(response, "response", request);
+    response_append(response, ",\"metrics\":{");
+    for (int s = 0; s < METRICS_NUM_STAGES; s++) {
+        metrics_summarize(s, &summary);
+        response_append(response,
+                        "\"%s\":{\"count\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u},",
+                        metrics_stage_name(s),
+                        summary.count,
+                        summary.p50,
+                        summary.p90,
+                        summary.p99,
+                        summary.max);
+    }
+    response_close(response, "}}");
+}
+
+// getter and setter of the registry entry
+int32_t measurement_get_period() {
+    return measurement_period;
+}
+
+esp_err_t measurement_update_period(int32_t period) {
+    // the scheduler keeps a running job aligned instead of
+    // restarting it from now
+    measurement_period = period;
+    scheduler_set_period(measurement_job, period);
+    ESP_LOGI(TAG, "Updated measurement period to %d seconds.", period);
+    return ESP_OK;
+}
+
+// high water marks of the arenas, read only
+int32_t request_arena_get_high_water() {
+    return arena_high_water(&request_arena);
+}
+
+int32_t measurement_arena_get_high_water() {
+    return arena_high_water(&measurement_arena);
+}
+
+static const registry_entry_t request_arena_entry = {
+    .name = "request_arena",
+    .type = REGISTRY_INT,
+    .get = request_arena_get_high_water};
+
+static const registry_entry_t measurement_arena_entry = {
+    .name = "measurement_arena",
+    .type = REGISTRY_INT,
+    .get = measurement_arena_get_high_water};
+
+static const registry_entry_t measurement_interval_entry = {
+    .name = "measurement_interval",
+    .type = REGISTRY_INT,
+    .min = 1,
+    .max = 7 * 86400,
+    .get = measurement_get_period,
+    .set = measurement_update_period};
+
+/** Handle one request and append its reply.
+
+**Parameters**
+    - *doc : the parsed message
+    - object : token index of the request object
+    - *response : the response to append the reply to
+
+**Description**
+    Extract the fields of the request in one pass over the
+    object. Distinguish get and set requests by the `type`.
+    A `get` makes a measurement or an aggregate or lists the
+    `config` or the latency `metrics`, a `set` updates a variable of the registry and
+    replies with its status. A variable marked `admin` is only set by a request
+    on the active key. Anything that fails replies with an error. Every
+    reply echoes the `id` of the request.
+*/
+void handle_request(pl_json_t *doc, int object, response_t *response) {
+    request_t request = {.doc = doc};
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    int32_t value_int;
+    char *name;
+    const registry_entry_t *entry;
+
+    pl_json_extract(doc, object, request_keys, request.fields, NUM_FIELDS);
+
+    if (pl_json_equals(doc, request.fields[FIELD_TYPE], "get") &&
+        pl_json_equals(doc, request.fields[FIELD_QUANTITY], "config")) {
+        append_config(response, &request);
+        err = ESP_OK;
+    } else if (pl_json_equals(doc, request.fields[FIELD_TYPE], "get") &&
+               pl_json_equals(doc, request.fields[FIELD_QUANTITY], "metrics")) {
+        append_metrics(response, &request);
+        err = ESP_OK;
+    } else if (pl_json_equals(doc, request.fields[FIELD_TYPE], "get")) {
+        // collapse the requested quantities into a plan
+        uint8_t plan = plan_quantities(&request);
+        ESP_LOGD(TAG, "GET request of quantities 0x%02x", plan);
+
+        if (pl_json_is(doc, request.fields[FIELD_AGGREGATE], PL_JSON_STRING)) {
+            // aggregate over an optional window in seconds
+            err = make_aggregate(response,
+                                 &request,
+                                 plan,
+                                 pl_json_string(doc, request.fields[FIELD_AGGREGATE]),
+                                 request_int(&request, FIELD_WINDOW, 0));
+        } else {
+            // optional maximum age of a cached sample in seconds
+            err = make_measurement(response,
+                                   &request,
+                                   plan,
+                                   request_int(&request, FIELD_MAX_AGE, 0));
+        }
+    } else if (pl_json_equals(doc, request.fields[FIELD_TYPE], "set")) {
+        // extract the name and value of the variable to set
+        name = pl_json_string(doc, request.fields[FIELD_NAME]);
+        entry = (name != NULL) ? registry_find(name) : NULL;
+
+        if (entry != NULL && entry->admin &&
+            !al_crypto_may_manage_keys(response->request->key_id)) {
+            // any other key of the keyring could replace the
+            // active key
+            ESP_LOGW(TAG, "SET request of variable %s with key %d denied", name, response->request->key_id);
+            err = ESP_ERR_INVALID_STATE;
+        } else if (name != NULL && pl_json_is(doc, request.fields[FIELD_VALUE], PL_JSON_STRING)) {
+            char *value = pl_json_string(doc, request.fields[FIELD_VALUE]);
+            // a write only variable like `key` is a secret
+            ESP_LOGD(TAG,
+                     "SET request of variable: %s to %s",
+                     name,
+                     (entry != NULL && entry->get == NULL) ? "<redacted>" : value);
+            err = registry_set_string(name, value);
+        } else if (name != NULL && pl_json_int(doc, request.fields[FIELD_VALUE], &value_int)) {
+            ESP_LOGD(TAG, "SET request of variable: %s to %d", name, value_int);
+            err = registry_set_int(name, value_int);
+        }
+
+        if (err == ESP_OK) {
+            response_begin(response, "status", &request);
+            response_append(response, ",\"status\":\"ok\"}");
+        }
+    } else {
+        ESP_LOGD(TAG, "request without known type");
+    }
+
+    if (err != ESP_OK) {
+        response_begin(response, "error", &request);
+        response_append(response, ",\"error\":\"%s\"}", esp_err_to_name(err));
+    }
+}
+
+/** Hold a measurement until the time is synchronized.
+
+**Parameters**
+    - *samples : samples of all quantities
+
+**Description**
+    Overwrite the oldest held measurement if the ring is
+    full and count it.
+*/
+void hold_measurement(const sample_t *samples) {
+    bool dropped;
+
+    xSemaphoreTake(conversion_lock, portMAX_DELAY);
+    dropped = (num_held == HELD_MEASUREMENTS);
+    if (dropped) {
+        num_held_dropped++;
+    } else {
+        num_held++;
+    }
+    memcpy(held[next_held], samples, sizeof(held[next_held]));
+    next_held = (next_held + 1) % HELD_MEASUREMENTS;
+    xSemaphoreGive(conversion_lock);
+
+    if (dropped) {
+        ESP_LOGW(TAG,
+                 "overwrote the oldest held measurement, %u dropped",
+                 num_held_dropped);
+    } else {
+        ESP_LOGI(TAG, "holding the measurement until the time is synchronized");
+    }
+}
+
+/** Send the measurements that were held back.
+
+**Parameters**
+    - *arena : arena of the calling task for the response
+
+**Description**
+    Do nothing if no measurement is held. Send them from the
+    oldest to the newest, the times are converted now, after
+    the synchronization.
+*/
+void send_held(arena_t *arena) {
+    sample_t samples[HELD_MEASUREMENTS][NUM_QUANTITIES];
+    response_t response;
+    int count;
+    int first;
+
+    xSemaphoreTake(conversion_lock, portMAX_DELAY);
+    count = num_held;
+    first = (next_held + HELD_MEASUREMENTS - num_held) % HELD_MEASUREMENTS;
+    for (int i = 0; i < count; i++) {
+        memcpy(samples[i], held[(first + i) % HELD_MEASUREMENTS], sizeof(samples[i]));
+    }
+    num_held = 0;
+    xSemaphoreGive(conversion_lock);
+
+    if (count == 0) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "sending %d held measurements", count);
+    for (int i = 0; i < count; i++) {
+        response_init(&response, arena, RESPONSE_LENGTH);
+        append_samples(&response, "measurement", NULL, ALL_QUANTITIES, samples[i]);
+        response_send(&response);
+        arena_reset(arena);
+    }
+}
+
+/** Function gets called when the measurement job is due.
 
 **Description**
     Perform the measurments of temperature and pressure.
     Save the system time of the measurment time point. Send
-    the results together with the time tag via UDP.
+    the results together with the time tag via UDP. Before
+    the first time synchronization hold the last
+    `HELD_MEASUREMENTS` results until
+    `al_weather_station_time_handler` or the next
+    measurement sends them, so a measurement never has a
+    time from 1970.
 */
 void measurement_callback() {
-    char time_buf[32];
-    char tx_buffer[256];
+    sample_t samples[NUM_QUANTITIES];
+    response_t response;
 
     ESP_LOGD(TAG, "measurement started");
 
-    int32_t t = al_bmp180_get_temperature();
-    int32_t p = al_bmp180_get_pressure(3);
-    get_time(time_buf);
+    // convert both quantities and refresh the cache
+    get_samples(ALL_QUANTITIES, 0, 3, samples);
+    for (int q = TEMPERATURE; q < NUM_QUANTITIES; q++) {
+        record_sample(q, samples[q].time, (float)samples[q].value / quantity_info[q].scale);
+    }
+    if (get_time_quality() == TIME_UNSYNCED) {
+        hold_measurement(samples);
+        return;
+    }
+    // in case the event of the synchronization was lost
+    send_held(&measurement_arena);
+    response_init(&response, &measurement_arena, RESPONSE_LENGTH);
+    append_samples(&response, "measurement", NULL, ALL_QUANTITIES, samples);
+    response_send(&response);
+    arena_reset(&measurement_arena);
+}
 
-    sprintf(tx_buffer,
-            "{\"type\":\"measurement\",\"time\":\"%s\",\"quantity\":["
-            "{\"name\":\"temperature\",\"value\": %.1f,\"unit\":\"celsius\"},"
-            "{\"name\":\"pressure\",\"value\": %.3f,\"unit\":\"hPa\"}]}",
-            time_buf, (float)t / 10, (float)p / 100);
+/** Evaluate a received message and reply to it.
 
-    pl_udp_send(tx_buffer);
+**Parameters**
+    - *message : the received message
+*/
+void handle_message(pl_udp_message_t *message) {
+    int64_t start = esp_timer_get_time();
+    pl_json_t doc;
+    pl_json_token_t *tokens;
+    response_t response;
+    int num_tokens;
+    int request;
+
+    metrics_record(METRICS_QUEUE, start - message->received);
+
+    tokens = arena_alloc(&request_arena, MAX_TOKENS * sizeof(pl_json_token_t));
+    if (tokens == NULL) {
+        arena_reset(&request_arena);
+        return;
+    }
+
+    // tokenize the received data in place and evaluate the
+    // requests
+    num_tokens = pl_json_parse(&doc, message->text, strlen(message->text), tokens, MAX_TOKENS);
+    metrics_record(METRICS_PARSE, esp_timer_get_time() - start);
+    start = esp_timer_get_time();
+    if (num_tokens < 0) {
+        ESP_LOGW(TAG, "Couldn't parse JSON: %d", num_tokens);
+        ESP_LOGV(TAG, "json string: '%s'", message->text);
+        arena_reset(&request_arena);
+        return;
+    }
+
+    response_init(&response, &request_arena, REPLY_LENGTH);
+    response.request = message;
+
+    if (pl_json_is(&doc, 0, PL_JSON_ARRAY)) {
+        // several requests in one message are executed in
+        // order and answered with one batched reply
+        ESP_LOGD(TAG, "batch of %d requests", doc.tokens[0].size);
+        response_append(&response, "{\"type\":\"batch\",\"results\":[");
+        request = 1;
+        for (int k = 0; k < doc.tokens[0].size; k++) {
+            handle_request(&doc, request, &response);
+            response_append(&response, ",");
+            request = pl_json_next(&doc, request);
+        }
+        response_close(&response, "]}");
+    } else if (pl_json_is(&doc, 0, PL_JSON_OBJECT)) {
+        handle_request(&doc, 0, &response);
+    } else {
+        ESP_LOGW(TAG, "JSON is neither an object nor an array");
+        arena_reset(&request_arena);
+        return;
+    }
+    metrics_record(METRICS_HANDLE, esp_timer_get_time() - start);
+
+    response_send(&response);
+    arena_reset(&request_arena);
+    metrics_record(METRICS_TOTAL, esp_timer_get_time() - message->received);
 }
 
 // PUBLIC FUNCTIONS
@@ -237,78 +1096,54 @@ void measurement_callback() {
 void al_weather_station_init() {
     ESP_LOGI(TAG, "init started");
 
-    // set up the timer stuff
-    const esp_timer_create_args_t measurement_timer_args = {
-        .callback = &measurement_callback, .name = "measurement"};
+    // set up the streaming statistics
+    stats_lock = xSemaphoreCreateMutex();
+    for (int q = 0; q < NUM_QUANTITIES; q++) {
+        al_stats_init(&stats[q]);
+    }
+    conversion_lock = xSemaphoreCreateMutex();
+
+    // memory of the requests and measurements
+    arena_init(&request_arena, "request_arena", request_block, REQUEST_ARENA_SIZE);
+    arena_init(&measurement_arena, "measurement_arena", measurement_block, MEASUREMENT_ARENA_SIZE);
 
     log_status(TAG,
-               esp_timer_create(&measurement_timer_args, &measurement_timer),
-               "create measurement timer");
+               scheduler_add("measurement",
+                             measurement_period,
+                             &measurement_callback,
+                             &measurement_job),
+               "add measurement job");
+
+    // make the measurement configurable by requests
+    registry_register(&measurement_interval_entry);
+    registry_register(&request_arena_entry);
+    registry_register(&measurement_arena_entry);
 
     ESP_LOGI(TAG, "init finished");
 }
 
 void al_weather_station_start(uint64_t period) {
-    log_status(TAG,
-               esp_timer_start_periodic(measurement_timer, period * 1000000),
-               "starting measurement timer");
+    measurement_period = period;
+    scheduler_set_period(measurement_job, period);
+    scheduler_start(measurement_job);
+    ESP_LOGV(TAG, "started measurement job");
 }
 
 void al_weather_station_stop() {
-    log_status(TAG,
-               esp_timer_stop(measurement_timer),
-               "stopped measurement timer");
+    scheduler_stop(measurement_job);
+    ESP_LOGV(TAG, "stopped measurement job");
 }
 
 void al_weather_station_handler(void *arg, esp_event_base_t base, int32_t id,
                                 void *data) {
-    cJSON *data_json = NULL;
-    cJSON *data_type = NULL;
-
-    // parse received data as json and evaluate the request
-    data_json = cJSON_Parse((char *)data);
-    if (data_json != NULL) {
-        // extract type to later distignuish get/set
-        data_type = cJSON_GetObjectItemCaseSensitive(data_json, "type");
-    } else {
-        ESP_LOGW(TAG, "Couldn't parse JSON");
-        ESP_LOGV(TAG, "json string: '%s'", (char *)data);
-    }
-
-    // handle get/set request
-    if (data_type != NULL) {
-        if (0 == strcmp(data_type->valuestring, "get")) {
-            // extract the quanities that are specified in the get request
-            cJSON *quantity = cJSON_GetObjectItemCaseSensitive(data_json, "quantity");
-
-            if (quantity != NULL) {
-                if (cJSON_IsArray(quantity)) {
-                    uint8_t num_quanties = cJSON_GetArraySize(quantity);
-                    ESP_LOGD(TAG, "GET request of %d quantities", num_quanties);
-                    // if quanitiy is an array loop through the elements of the array
-                    for (uint8_t k = 0; k < num_quanties; k++) {
-                        make_measurement(cJSON_GetArrayItem(quantity, k)->valuestring);
-                    }
-                } else {
-                    // handle the request if quantity is just a single element
-                    ESP_LOGD(TAG, "GET request of quantity: %s", quantity->valuestring);
-                    make_measurement(quantity->valuestring);
-                }
-            }
-        } else if (0 == strcmp(data_type->valuestring, "set")) {
-            // extract the name and value of the variable to set
-            cJSON *name = cJSON_GetObjectItemCaseSensitive(data_json, "name");
-            cJSON *value = cJSON_GetObjectItemCaseSensitive(data_json, "value");
-
-            if ((name != NULL) & (value != NULL)) {
-                if (cJSON_IsString(value)) {
-                    ESP_LOGD(TAG, "SET request of variable: %s to %s", name->valuestring, value->valuestring);
-                    set_variable_string(name->valuestring, value->valuestring);
-                } else if (cJSON_IsNumber(value)) {
-                    ESP_LOGD(TAG, "SET request of variable: %s to %d", name->valuestring, value->valueint);
-                    set_variable_int(name->valuestring, value->valueint);
-                }
-            }
-        }
-    }
-}
\ No newline at end of file
+    handle_message((pl_udp_message_t *)data);
+    // let pl_udp accept the next message
+    pl_udp_done();
+}
+
+void al_weather_station_time_handler(void *arg, esp_event_base_t base, int32_t id,
+                                     void *data) {
+    // the handlers of the event loop share the request
+    // arena, the measurement arena belongs to the job
+    send_held(&request_arena);
+}
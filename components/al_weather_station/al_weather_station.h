@@ -7,39 +7,40 @@
 #include "esp_event.h"
 #include "esp_timer.h"
 
-/** Initialize the measurement timer.
+/** Initialize the measurement job.
+
+**Requirements**
+    Initialize the scheduler first with `scheduler_init`.
 
 **Description**
-    Set the esp_timer args with the callback and a name.
-    Create the timer with `esp_timer_create`.
+    Add the measurement as a stopped job to the scheduler.
 */
 void al_weather_station_init();
 
-/** Start the measurement timer.
+/** Start the measurement job.
 
 **Parameters**
     - period: 
-        the period of the periodic timer in seconds
+        the period of the measurements in seconds
 
 **Requirements**
-    Initialize the timer first with
+    Initialize the job first with
     `al_weather_station_init`.
 
 **Description**
-    Start the timer from `al_weather_station_init` with the
+    Start the job from `al_weather_station_init` with the
     given period.
 */
 void al_weather_station_start(uint64_t period);
 
-/** Stop the measurement timer.
+/** Stop the measurement job.
 
 **Requirements**
-    Initialize the timer first with
-    `al_weather_station_init`. The measurement timer must
-    also be running.
+    Initialize the job first with
+    `al_weather_station_init`.
 
 **Description**
-    Stop the timer from `al_weather_station_init`.
+    Stop the job from `al_weather_station_init`.
 */
 void al_weather_station_stop();
 
@@ -49,7 +50,7 @@ void al_weather_station_stop();
     - *arg : pointer to arguments of the event
     - base : event base
     - id : event id
-    - *data : pointer to event data
+    - *data : the received `pl_udp_message_t`
 
 **Requirements**
     Handler musst be registered for base `UDP_EVENT` and id
@@ -59,10 +60,34 @@ void al_weather_station_stop();
     Parse the incoming UDP message as JSON. Depending on the
     type perfom different actions. `get` will trigger making 
     a measurement. `set` will update an internal variable.
+    Call `pl_udp_done()` when the message is finished.
 */
 void al_weather_station_handler(void* arg,
                                 esp_event_base_t base,
                                 int32_t id,
                                 void* data);
 
+/** Event handler for time synchronizations.
+
+**Parameters**
+    - *arg : pointer to arguments of the event
+    - base : event base
+    - id : event id
+    - *data : event data
+
+**Requirements**
+    Handler musst be registered for base `TIMESYNC_EVENT`
+    and id `TIMESYNC_EVENT_SYNCED` on the default event
+    loop.
+
+**Description**
+    Send the measurement that was held back because the
+    time was not synchronized yet, with the time of the
+    measurement.
+*/
+void al_weather_station_time_handler(void* arg,
+                                     esp_event_base_t base,
+                                     int32_t id,
+                                     void* data);
+
 #endif  // _AL_WEATHER_STATION_H_
\ No newline at end of file
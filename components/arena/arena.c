@@ -0,0 +1,60 @@
+// MISCELLANEOUS
+// Source file of the arena component.
+
+#include "./arena.h"
+
+#include "../general/general.h"
+
+static const char *TAG = "arena";
+
+// PUBLIC FUNCTIONS
+
+void arena_init(arena_t *arena, const char *name, void *block, uint32_t size) {
+    // skip the bytes in front of the first aligned address
+    uint32_t offset = -(uintptr_t)block & (ARENA_ALIGNMENT - 1);
+
+    arena->name = name;
+    arena->block = (uint8_t *)block + offset;
+    arena->size = (size > offset) ? size - offset : 0;
+    arena->used = 0;
+    arena->high_water = 0;
+
+    ESP_LOGV(TAG, "init %s with %u bytes", name, arena->size);
+}
+
+void *arena_alloc(arena_t *arena, uint32_t size) {
+    // round up so the next allocation stays aligned
+    uint32_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(uint32_t)(ARENA_ALIGNMENT - 1);
+    void *memory;
+
+    if (size > arena->size - arena->used || aligned > arena->size - arena->used) {
+        ESP_LOGW(TAG,
+                 "%s exhausted: %u bytes requested, %u of %u bytes used",
+                 arena->name,
+                 size,
+                 arena->used,
+                 arena->size);
+        return NULL;
+    }
+
+    memory = arena->block + arena->used;
+    arena->used += aligned;
+    return memory;
+}
+
+void arena_reset(arena_t *arena) {
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+        ESP_LOGD(TAG,
+                 "%s high water mark %u of %u bytes",
+                 arena->name,
+                 arena->high_water,
+                 arena->size);
+    }
+    arena->used = 0;
+}
+
+uint32_t arena_high_water(const arena_t *arena) {
+    // include the allocations of a request in progress
+    return (arena->used > arena->high_water) ? arena->used : arena->high_water;
+}
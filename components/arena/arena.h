@@ -0,0 +1,74 @@
+// MISCELLANEOUS
+// Header file of the arena component.
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+
+// alignment of every allocation in bytes
+#define ARENA_ALIGNMENT 4
+
+// bump pointer allocator on a fixed block of memory
+typedef struct arena_t {
+    // name for the log messages
+    const char *name;
+    uint8_t *block;
+    uint32_t size;
+    // bytes handed out since the last reset
+    uint32_t used;
+    // largest `used` ever reached
+    uint32_t high_water;
+} arena_t;
+
+/** Initialize an arena on a block of memory.
+
+**Parameters**
+    - *arena : the arena
+    - *name : name for the log messages
+    - *block : backing memory, usually a static array
+    - size : size of the block in bytes
+
+**Description**
+    The start of the block is aligned to `ARENA_ALIGNMENT`.
+    The block is owned by the caller and is never freed. An
+    arena is not thread safe, each task that assembles
+    requests uses its own arena.
+*/
+void arena_init(arena_t *arena, const char *name, void *block, uint32_t size);
+
+/** Allocate memory from an arena.
+
+**Parameters**
+    - *arena : the arena
+    - size : number of bytes
+
+**Return**
+    Pointer to `size` bytes aligned to `ARENA_ALIGNMENT` or
+    NULL if the block is exhausted.
+
+**Description**
+    Move the bump pointer forward. The memory is not
+    initialized and is valid until the next `arena_reset`.
+*/
+void *arena_alloc(arena_t *arena, uint32_t size);
+
+/** Release all allocations of an arena.
+
+**Parameters**
+    - *arena : the arena
+
+**Description**
+    Call this when a request is completed. The high water
+    mark is updated and logged when it grows.
+*/
+void arena_reset(arena_t *arena);
+
+/** Get the high water mark of an arena.
+
+**Return**
+    The largest number of bytes that were in use at once.
+*/
+uint32_t arena_high_water(const arena_t *arena);
+
+#endif  // _ARENA_H_
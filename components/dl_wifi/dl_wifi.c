@@ -5,12 +5,18 @@
 #include "./dl_wifi.h"
 
 #include "../general/general.h"
+#include "../registry/registry.h"
+
+// c
+#include <string.h>
 
 // esp-idf
 #include "esp_log.h"
 #include "esp_netif.h"
-#include "esp_sntp.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "nvs.h"
 
 // default values for wifi config. get them from sdkconfig.h
 // which is made from the options in Kconfig.
@@ -25,20 +31,316 @@
 #define DEFAULT_SCAN_METHOD WIFI_FAST_SCAN
 #endif
 
-// time to wait in seconds before reconnecting to wifi
-// station
-#define RECONNECT_TIME 10
+// bounds of the delay before a reconnect in milliseconds
+#define BACKOFF_MIN CONFIG_APP_WIFI_BACKOFF_MIN
+#define BACKOFF_MAX CONFIG_APP_WIFI_BACKOFF_MAX
+
+// connects that may reuse a lease before DHCP runs again
+#if CONFIG_APP_WIFI_IP_REUSE
+#define MAX_REUSES CONFIG_APP_WIFI_IP_REUSE_MAX
+#endif
 
 static const char *TAG = "dl_wifi";
 
+// number of reconnects after a disconnect since the boot
+uint32_t num_reconnects = 0;
+// failed connects since the last IP address, sets the
+// backoff
+uint32_t num_attempts = 0;
+// delay of the last scheduled reconnect in milliseconds
+uint32_t last_backoff = 0;
+// duration of the last outage from the disconnect to the
+// next IP address in milliseconds
+uint32_t last_outage = 0;
+// time of `esp_timer_get_time` when the connection was
+// lost, 0 while connected
+int64_t disconnected_at = 0;
+
+// one shot timer of the next reconnect
+esp_timer_handle_t reconnect_timer;
+
+// last access point and DHCP lease that gave an IP
+// address, kept in NVS
+typedef struct wifi_cache_t {
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t dns;
+    // connects without DHCP since the lease was acquired
+    uint16_t reuses;
+} wifi_cache_t;
+
+nvs_handle_t wifi_nvs;
+wifi_cache_t cache;
+bool cache_valid = false;
+// the configuration connects to the cached access point
+bool use_cache = false;
+// the station has an IP address
+bool connected = false;
+// the IP address of this connect is the cached lease
+bool reused = false;
+
+esp_netif_t *sta_netif;
+
+// time of `esp_timer_get_time` of the last connect
+int64_t attempt_start = 0;
+// time from the last connect to the IP address in
+// milliseconds
+uint32_t time_to_ip = 0;
+
+// PRIVATE FUNCTIONS
+
+/** Start a connection attempt.
+
+**Description**
+    Note the start for the time to the IP address.
+*/
+void start_attempt() {
+    attempt_start = esp_timer_get_time();
+    log_status(TAG,
+               esp_wifi_connect(),
+               "esp_wifi_connect");
+}
+
+/** Configure the station.
+
+**Parameters**
+    - cached : connect to the cached access point on its
+        channel instead of scanning
+
+**Description**
+    Takes effect with the next connect.
+*/
+void apply_config(bool cached) {
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = DEFAULT_SSID,
+            .password = DEFAULT_PWD,
+            .scan_method = DEFAULT_SCAN_METHOD},
+    };
+
+    if (cached) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        wifi_config.sta.channel = cache.channel;
+    }
+    use_cache = cached;
+
+    log_status(TAG,
+               esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config),
+               "esp_wifi_set_config");
+}
+
+/** Read the cache from NVS. */
+void load_cache() {
+    size_t length = sizeof(cache);
+
+    log_status(TAG,
+               nvs_open("dl_wifi", NVS_READWRITE, &wifi_nvs),
+               "nvs_open");
+    cache_valid = (nvs_get_blob(wifi_nvs, "cache", &cache, &length) == ESP_OK &&
+                   length == sizeof(cache));
+    ESP_LOGD(TAG, "cached access point: %s", cache_valid ? "yes" : "no");
+}
+
+/** Update the cache after an IP address was assigned.
+
+**Parameters**
+    - *ip_info : the assigned address
+
+**Description**
+    Only write to the flash if the access point or the
+    lease changed. A lease from DHCP starts the count of
+    reuses over.
+*/
+void store_cache(const esp_netif_ip_info_t *ip_info) {
+    wifi_cache_t fresh;
+    wifi_ap_record_t ap_info;
+    esp_netif_dns_info_t dns_info;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    memset(&fresh, 0, sizeof(fresh));
+    memcpy(fresh.bssid, ap_info.bssid, sizeof(fresh.bssid));
+    fresh.channel = ap_info.primary;
+    fresh.ip_info = *ip_info;
+    fresh.reuses = reused ? cache.reuses : 0;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK) {
+        fresh.dns = dns_info.ip.u_addr.ip4;
+    }
+
+    if (cache_valid && 0 == memcmp(&fresh, &cache, sizeof(cache))) {
+        return;
+    }
+    cache = fresh;
+    cache_valid = true;
+    log_status(TAG,
+               nvs_set_blob(wifi_nvs, "cache", &cache, sizeof(cache)),
+               "store wifi cache");
+    log_status(TAG, nvs_commit(wifi_nvs), "commit wifi cache");
+}
+
+/** Use a fixed IP address instead of DHCP.
+
+**Parameters**
+    - *ip_info : address, netmask and gateway
+    - dns : address of the DNS server
+*/
+void set_static_ip(const esp_netif_ip_info_t *ip_info, esp_ip4_addr_t dns) {
+    esp_netif_dns_info_t dns_info = {
+        .ip = {.u_addr = {.ip4 = dns}, .type = ESP_IPADDR_TYPE_V4}};
+
+    // fails harmlessly if the client is stopped already
+    esp_netif_dhcpc_stop(sta_netif);
+    log_status(TAG,
+               esp_netif_set_ip_info(sta_netif, ip_info),
+               "esp_netif_set_ip_info");
+    log_status(TAG,
+               esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info),
+               "esp_netif_set_dns_info");
+}
+
+/** Choose the IP address after the connection.
+
+**Description**
+    Depending on the config use DHCP, the static address or
+    the cached lease. A lease is only reused on the cached
+    access point and for `MAX_REUSES` connects, otherwise
+    DHCP runs and renews it. The station cannot tell the
+    expiry of the lease before SNTP, so the count bounds
+    how long an address is used without the DHCP server.
+*/
+void assign_ip() {
+#if CONFIG_APP_WIFI_IP_STATIC
+    esp_netif_ip_info_t ip_info = {
+        .ip = {.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_IP)},
+        .netmask = {.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_NETMASK)},
+        .gw = {.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_GW)}};
+    esp_ip4_addr_t dns = {.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_DNS)};
+
+    set_static_ip(&ip_info, dns);
+#else
+#if CONFIG_APP_WIFI_IP_REUSE
+    reused = use_cache && cache.reuses < MAX_REUSES;
+    if (reused) {
+        cache.reuses++;
+        log_status(TAG,
+                   nvs_set_blob(wifi_nvs, "cache", &cache, sizeof(cache)),
+                   "store wifi cache");
+        log_status(TAG, nvs_commit(wifi_nvs), "commit wifi cache");
+        ESP_LOGI(TAG, "reusing the lease, %u of %u", cache.reuses, MAX_REUSES);
+        set_static_ip(&cache.ip_info, cache.dns);
+        return;
+    }
+    if (use_cache) {
+        ESP_LOGI(TAG, "lease reused %u times, renewing it", cache.reuses);
+    }
+#endif
+    // fails harmlessly if the client runs already
+    esp_netif_dhcpc_start(sta_netif);
+#endif
+}
+
+/** Function gets called when the reconnect timer runs out.
+
+**Description**
+    Runs in the esp_timer task, the event loop is never
+    blocked while waiting.
+*/
+void reconnect_callback(void *arg) {
+    ESP_LOGI(TAG, "reconnecting, attempt %u", num_attempts);
+    start_attempt();
+}
+
+/** Schedule the next reconnect.
+
+**Description**
+    The delay doubles with every failed attempt from
+    `BACKOFF_MIN` up to `BACKOFF_MAX`. A random jitter
+    takes the delay from half to the full value, so several
+    stations do not reconnect in lockstep after the access
+    point comes back.
+*/
+void schedule_reconnect() {
+    uint32_t delay = BACKOFF_MIN;
+
+    for (uint32_t a = 1; a < num_attempts && delay < BACKOFF_MAX; a++) {
+        delay *= 2;
+    }
+    if (delay > BACKOFF_MAX) {
+        delay = BACKOFF_MAX;
+    }
+    delay = delay / 2 + esp_random() % (delay / 2 + 1);
+    last_backoff = delay;
+
+    ESP_LOGW(TAG, "trying to reconnect in %u ms", delay);
+    // fails harmlessly if the timer is not armed
+    esp_timer_stop(reconnect_timer);
+    log_status(TAG,
+               esp_timer_start_once(reconnect_timer, (uint64_t)delay * 1000),
+               "start reconnect timer");
+}
+
+// getters of the registry entries
+int32_t get_num_reconnects() {
+    return num_reconnects;
+}
+
+int32_t get_last_backoff() {
+    return last_backoff;
+}
+
+int32_t get_last_outage() {
+    return last_outage;
+}
+
+int32_t get_time_to_ip() {
+    return time_to_ip;
+}
+
+static const registry_entry_t reconnects_entry = {
+    .name = "wifi_reconnects",
+    .type = REGISTRY_INT,
+    .get = get_num_reconnects};
+
+static const registry_entry_t backoff_entry = {
+    .name = "wifi_backoff",
+    .type = REGISTRY_INT,
+    .get = get_last_backoff};
+
+static const registry_entry_t outage_entry = {
+    .name = "wifi_outage",
+    .type = REGISTRY_INT,
+    .get = get_last_outage};
+
+static const registry_entry_t time_to_ip_entry = {
+    .name = "wifi_time_to_ip",
+    .type = REGISTRY_INT,
+    .get = get_time_to_ip};
+
+// PUBLIC FUNCTIONS
+
 void dl_wifi_init() {
+    const esp_timer_create_args_t reconnect_timer_args = {
+        .callback = &reconnect_callback,
+        .name = "wifi-reconnect"};
+
+    log_status(TAG,
+               esp_timer_create(&reconnect_timer_args, &reconnect_timer),
+               "create reconnect timer");
+    registry_register(&reconnects_entry);
+    registry_register(&backoff_entry);
+    registry_register(&outage_entry);
+    registry_register(&time_to_ip_entry);
+
     // create a LwIP core task and initialize LwIP related
     // work, see `esp_netif.h`. formerly this was the
     // tcpip_adapter.
     log_status(TAG, esp_netif_init(), "esp_netif_init");
 
     // create a default wifi station
-    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
     assert(sta_netif);
 
     // create wifi init configuration object from default,
@@ -48,25 +350,18 @@ void dl_wifi_init() {
     // init with config object
     log_status(TAG, esp_wifi_init(&cfg), "esp_wifi_init");
 
-    // wifi contiguration object in station mode (conncect
-    // to access point)
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = DEFAULT_SSID,
-            .password = DEFAULT_PWD,
-            .scan_method = DEFAULT_SCAN_METHOD},
-    };
-
     // set mode to station mode which means it will connect
     // to another access point.
     log_status(TAG,
                esp_wifi_set_mode(WIFI_MODE_STA),
                "esp_wifi_set_mode station mode");
 
-    // apply the wifi configuration object
-    log_status(TAG,
-               esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config),
-               "esp_wifi_set_config default config with ssid and password");
+    // configure ssid and password, skip the scan if the
+    // last access point is known
+#if CONFIG_APP_WIFI_CACHE_AP
+    load_cache();
+#endif
+    apply_config(cache_valid);
 
     // start wifi component this post WIFI_EVENT_STA_START
     log_status(TAG,
@@ -98,34 +393,82 @@ void dl_wifi_handler(void *arg,
                 // this event is posted right after
                 // `esp_wifi_start`. now you can connect to
                 // the wifi network
-                log_status(TAG,
-                           esp_wifi_connect(),
-                           "esp_wifi_connect");
+                start_attempt();
                 break;
             case WIFI_EVENT_STA_CONNECTED:
                 ESP_LOGI(TAG, "Connected to network");
-                // now the DHCP process will start
-                // internally. nothing from the main task is
-                // required. after successful DHCP process
-                // the event IP_EVENT_STA_GOT_IP will be
-                // posted
+                // now the DHCP process will start unless a
+                // static address is used. after that the
+                // event IP_EVENT_STA_GOT_IP will be posted
+                assign_ip();
                 break;
 
             case WIFI_EVENT_STA_DISCONNECTED:
-                ESP_LOGW(TAG,
-                         "Got disconnected, trying to reconnect in %ds",
-                         RECONNECT_TIME);
-                sntp_stop();
-
-                vTaskDelay(RECONNECT_TIME * 1000 / portTICK_PERIOD_MS);
-                log_status(TAG,
-                           esp_wifi_connect(),
-                           "esp_wifi_connect");
+                if (connected) {
+                    // try the cached access point first
+                    connected = false;
+                    if (cache_valid && !use_cache) {
+                        apply_config(true);
+                    }
+                } else if (use_cache) {
+                    // the cached access point is gone
+                    ESP_LOGI(TAG, "cached access point failed, scanning");
+                    apply_config(false);
+                }
+
+                // also posted for every failed attempt
+                if (disconnected_at == 0) {
+                    ESP_LOGW(TAG, "Got disconnected");
+                    disconnected_at = esp_timer_get_time();
+                    num_reconnects++;
+                }
+                num_attempts++;
+                schedule_reconnect();
                 break;
 
             default:
                 // nothing
                 break;
         }
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)data;
+
+        connected = true;
+        time_to_ip = (esp_timer_get_time() - attempt_start) / 1000;
+        ESP_LOGI(TAG,
+                 "got ip " IPSTR " in %u ms from %s",
+                 IP2STR(&event->ip_info.ip),
+                 time_to_ip,
+                 use_cache ? "cached access point" : "scan");
+#if CONFIG_APP_WIFI_CACHE_AP
+        store_cache(&event->ip_info);
+#endif
+
+        // connected again, the next outage starts with the
+        // shortest backoff
+        esp_timer_stop(reconnect_timer);
+        if (disconnected_at != 0) {
+            last_outage = (esp_timer_get_time() - disconnected_at) / 1000;
+            ESP_LOGI(TAG,
+                     "reconnected after %u ms and %u attempts",
+                     last_outage,
+                     num_attempts);
+        }
+        disconnected_at = 0;
+        num_attempts = 0;
     }
 }
+
+esp_err_t dl_wifi_get_rssi(int8_t *rssi) {
+    wifi_ap_record_t ap_info;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&ap_info);
+
+    if (err == ESP_OK) {
+        *rssi = ap_info.rssi;
+    }
+    return err;
+}
+
+uint32_t dl_wifi_get_reconnects() {
+    return num_reconnects;
+}
@@ -21,7 +21,10 @@
     object. Configure the wifi driver with password and ssid
     as given in menuconfig. Set to station mode and start.
     Wifi is ready to use when the event IP_EVENT_GOT_IP is
-    thrown.
+    thrown. Create the reconnect timer and register the
+    read only variables `wifi_reconnects`, `wifi_backoff`,
+    `wifi_outage` and `wifi_time_to_ip`. If the last access
+    point is cached in NVS connect to it without a scan.
 */
 void dl_wifi_init();
 
@@ -39,12 +42,43 @@ void dl_wifi_init();
     event are given as arguments to the handler. WiFi Events
     are: On WIFI_EVENT_STA_START connect to wifi network, on
     WIFI_EVENT_STA_CONNECTED do nothing and on
-    WIFI_EVENT_STA_DISCONNECTED reconnect. Ip event is: On
-    IP_EVENT_STA_GOT_IP log ip address.  
+    WIFI_EVENT_STA_DISCONNECTED schedule a reconnect with a
+    one shot timer and exponential backoff, so the event
+    loop keeps running. A failed attempt on the cached
+    access point falls back to a scan. On
+    WIFI_EVENT_STA_CONNECTED start DHCP or set the static
+    or cached address. Ip event is: On IP_EVENT_STA_GOT_IP
+    log the time to the address, cache the access point and
+    the lease, stop the timer, note the outage and reset
+    the backoff.  
 */
 void dl_wifi_handler(void *arg,
                      esp_event_base_t base,
                      int32_t id,
                      void *data);
 
+/** Get the signal strength of the access point.
+
+**Parameters**
+    - *rssi : output for the RSSI in dBm
+
+**Return**
+    - err:
+        `ESP_ERR_WIFI_NOT_CONNECT` if the station is not
+        connected and `ESP_OK` otherwise
+
+**Description**
+    Read the RSSI of the last received beacon with
+    `esp_wifi_sta_get_ap_info`.
+*/
+esp_err_t dl_wifi_get_rssi(int8_t *rssi);
+
+/** Get the number of reconnects.
+
+**Return**
+    Number of times the station reconnected after it got
+    disconnected since the boot.
+*/
+uint32_t dl_wifi_get_reconnects();
+
 #endif  // _DL_WIFI_H_
\ No newline at end of file
@@ -3,9 +3,34 @@
 
 #include "./general.h"
 
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <time.h>
 
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// length of the date part "YYYY-MM-DDT" of a timestamp
+#define DATE_LENGTH 11
+#define SECONDS_PER_DAY 86400
+
+// date of the day that was formatted last
+static int64_t cached_day = -1;
+static char cached_date[DATE_LENGTH];
+static portMUX_TYPE date_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// wall clock microseconds minus monotonic microseconds of
+// `esp_timer_get_time`. after a sync the offset in use
+// moves from `base_offset` at `slew_start` towards
+// `target_offset` with the slew rate.
+static int64_t base_offset = 0;
+static int64_t target_offset = 0;
+static int64_t slew_start = 0;
+static bool synced = false;
+static portMUX_TYPE offset_lock = portMUX_INITIALIZER_UNLOCKED;
+
 void log_status(const char *tag,
                 esp_err_t status,
                 const char *msg) {
@@ -24,28 +49,201 @@ void log_status(const char *tag,
     }
 }
 
-void get_time(char *buf) {
-    time_t epoch;
-    struct tm date;
+/** Write a number with a fixed number of digits.
 
-    // get current time
-    time(&epoch);
-    // set time zone
+**Parameters**
+    - *buf : output, not null terminated
+    - value : the number
+    - digits : number of digits, leading zeros are added
+
+**Return**
+    Pointer behind the last digit.
+*/
+char *put_digits(char *buf, uint32_t value, int digits) {
+    for (int d = digits - 1; d >= 0; d--) {
+        buf[d] = '0' + value % 10;
+        value /= 10;
+    }
+    return buf + digits;
+}
+
+/** Get the wall clock time of the system.
+
+**Return**
+    Microseconds since the epoch from `gettimeofday`.
+*/
+int64_t get_system_us() {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/** Get the offset from monotonic to wall clock time.
+
+**Parameters**
+    - monotonic : time of `esp_timer_get_time`
+
+**Return**
+    Offset in microseconds to add to the monotonic time.
+
+**Requirements**
+    Hold the `offset_lock` and be synchronized.
+
+**Description**
+    Without slewing a new offset applies at once. With
+    slewing the offset changes by at most
+    `CONFIG_TIME_SLEW_RATE` microseconds per second, so the
+    converted times stay monotonic.
+*/
+int64_t current_offset(int64_t monotonic) {
+#ifdef CONFIG_TIME_SLEW
+    int64_t diff = target_offset - base_offset;
+    int64_t max = 0;
+
+    if (monotonic > slew_start) {
+        max = (monotonic - slew_start) * CONFIG_TIME_SLEW_RATE / 1000000;
+    }
+    if (diff > max) {
+        return base_offset + max;
+    } else if (diff < -max) {
+        return base_offset - max;
+    }
+#endif
+    return target_offset;
+}
+
+void init_time() {
+    // only `localtime` needs the time zone, all timestamps
+    // are formatted in UTC
     setenv("TZ", "CET-1", 1);
     tzset();
-    // get time in time zone format
-    // localtime_r(&epoch, &date);
-    // get time in UTC
-    gmtime_r(&epoch, &date);
-    // convert time to string
-    sprintf(buf,
-            "%04d-%02d-%02dT%02d:%02d:%02dZ",
-            date.tm_year + 1900,
-            date.tm_mon + 1,
-            date.tm_mday,
-            date.tm_hour,
-            date.tm_min,
-            date.tm_sec);
+}
+
+void time_synced() {
+    int64_t now = esp_timer_get_time();
+    int64_t offset = get_system_us() - now;
+
+    portENTER_CRITICAL(&offset_lock);
+    if (synced) {
+        // slew from the offset in use
+        base_offset = current_offset(now);
+    } else {
+        // the first sync always steps, the samples before
+        // are converted with it
+        base_offset = offset;
+    }
+    target_offset = offset;
+    slew_start = now;
+    synced = true;
+    portEXIT_CRITICAL(&offset_lock);
+}
+
+time_quality_t get_time_quality() {
+    int64_t now = esp_timer_get_time();
+    time_quality_t quality = TIME_UNSYNCED;
+
+    portENTER_CRITICAL(&offset_lock);
+    if (synced) {
+        quality = (current_offset(now) == target_offset) ? TIME_SYNCED : TIME_SLEWING;
+    }
+    portEXIT_CRITICAL(&offset_lock);
+    return quality;
+}
+
+int64_t get_time_correction() {
+    int64_t now = esp_timer_get_time();
+    int64_t pending = 0;
+
+    portENTER_CRITICAL(&offset_lock);
+    if (synced) {
+        pending = llabs(target_offset - current_offset(now));
+    }
+    portEXIT_CRITICAL(&offset_lock);
+    return pending;
+}
+
+int64_t monotonic_to_epoch_us(int64_t monotonic) {
+    int64_t offset;
+
+    portENTER_CRITICAL(&offset_lock);
+    if (synced) {
+        offset = current_offset(monotonic);
+        portEXIT_CRITICAL(&offset_lock);
+    } else {
+        portEXIT_CRITICAL(&offset_lock);
+        // follow the clock until the first sync
+        offset = get_system_us() - esp_timer_get_time();
+    }
+    return monotonic + offset;
+}
+
+int64_t get_epoch_us() {
+    return monotonic_to_epoch_us(esp_timer_get_time());
+}
+
+void get_time(char *buf) {
+    format_time_us(get_epoch_us(), 0, buf);
+}
+
+void format_time(time_t epoch, char *buf) {
+    format_time_us((int64_t)epoch * 1000000, 0, buf);
+}
+
+int format_time_us(int64_t epoch_us, int decimals, char *buf) {
+    int64_t seconds = (epoch_us > 0) ? epoch_us / 1000000 : 0;
+    uint32_t fraction = (epoch_us > 0) ? epoch_us % 1000000 : 0;
+    int64_t day = seconds / SECONDS_PER_DAY;
+    uint32_t second = seconds % SECONDS_PER_DAY;
+    bool cached;
+    time_t midnight;
+    struct tm date;
+    char *p = buf;
+
+    portENTER_CRITICAL(&date_lock);
+    cached = (day == cached_day);
+    if (cached) {
+        memcpy(p, cached_date, DATE_LENGTH);
+    }
+    portEXIT_CRITICAL(&date_lock);
+
+    if (!cached) {
+        // the date changes once a day
+        midnight = (time_t)(day * SECONDS_PER_DAY);
+        gmtime_r(&midnight, &date);
+        p = put_digits(p, date.tm_year + 1900, 4);
+        *p++ = '-';
+        p = put_digits(p, date.tm_mon + 1, 2);
+        *p++ = '-';
+        p = put_digits(p, date.tm_mday, 2);
+        *p = 'T';
+
+        portENTER_CRITICAL(&date_lock);
+        memcpy(cached_date, buf, DATE_LENGTH);
+        cached_day = day;
+        portEXIT_CRITICAL(&date_lock);
+    }
+
+    p = buf + DATE_LENGTH;
+    p = put_digits(p, second / 3600, 2);
+    *p++ = ':';
+    p = put_digits(p, second / 60 % 60, 2);
+    *p++ = ':';
+    p = put_digits(p, second % 60, 2);
+
+    if (decimals > 6) {
+        decimals = 6;
+    }
+    if (decimals > 0) {
+        *p++ = '.';
+        for (int d = decimals; d < 6; d++) {
+            fraction /= 10;
+        }
+        p = put_digits(p, fraction, decimals);
+    }
+    *p++ = 'Z';
+    *p = '\0';
+    return p - buf;
 }
 
 long get_seed() {
@@ -4,14 +4,30 @@
 #ifndef _GENERAL_H_
 #define _GENERAL_H_
 
+#include <stdint.h>
+#include <time.h>
+
 // needed for `esp_err_t`
 #include "esp_err.h"
 // needed for ESP_LOG macros
 #include "esp_log.h"
+// needed for the log levels of the config
+#include "sdkconfig.h"
 
-// define the global log level of all files that
-// include this file
-#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+// define the compile time log level of all files that
+// include this file. a file in a hot path defines
+// `LOG_COMPONENT_LEVEL` before the include to drop its
+// verbose logs, the lower of both levels is used. the
+// levels are plain numbers so `#if` can compare them.
+#undef LOG_LOCAL_LEVEL
+#ifdef LOG_COMPONENT_LEVEL
+#define LOG_LOCAL_LEVEL                        \
+    (LOG_COMPONENT_LEVEL < CONFIG_APP_LOG_LEVEL \
+         ? LOG_COMPONENT_LEVEL                  \
+         : CONFIG_APP_LOG_LEVEL)
+#else
+#define LOG_LOCAL_LEVEL CONFIG_APP_LOG_LEVEL
+#endif
 
 // enable error code lookup
 // #define CONFIG_ESP_ERR_TO_NAME_LOOKUP
@@ -32,20 +48,140 @@ void log_status(const char *tag,
                 esp_err_t status,
                 const char *msg);
 
+// buffer length for a timestamp with microseconds,
+// YYYY-MM-DDTHH:MM:SS.ffffffZ
+#define TIME_STRING_LENGTH 28
+
+/** Set the time zone.
+
+**Description**
+    Set `TZ` once at the start instead of before every
+    formatted time, changing the environment is not thread
+    safe. The timestamps are in UTC, the time zone only
+    affects `localtime`.
+*/
+void init_time();
+
+// quality of the wall clock time
+typedef enum {
+    // never synchronized, the time may count from 1970
+    TIME_UNSYNCED,
+    // synchronized, a correction is still slewed in
+    TIME_SLEWING,
+    // synchronized
+    TIME_SYNCED
+} time_quality_t;
+
+/** Take the offset of a new time synchronization.
+
+**Requirements**
+    Call it after sntp has set the system time.
+
+**Description**
+    Store the offset of the system time to the monotonic
+    time of `esp_timer_get_time`. All wall clock times are
+    derived from the monotonic time with this offset, so
+    they do not jump when the system time is set. With
+    `CONFIG_TIME_SLEW` a later correction is applied
+    gradually, only the first synchronization steps.
+*/
+void time_synced();
+
+/** Get the quality of the wall clock time
+
+**Return**
+    `TIME_UNSYNCED` before the first synchronization,
+    `TIME_SLEWING` while a correction is applied and
+    `TIME_SYNCED` otherwise.
+*/
+time_quality_t get_time_quality();
+
+/** Get the correction that is not slewed in yet
+
+**Return**
+    Difference of the wall clock time to the last
+    synchronization in microseconds, 0 if it is fully
+    applied or the time is not synchronized.
+*/
+int64_t get_time_correction();
+
+/** Convert a monotonic time to wall clock time
+
+**Parameters**
+    - monotonic: time of `esp_timer_get_time` in
+        microseconds
+
+**Return**
+    Microseconds since the epoch.
+
+**Description**
+    Timestamp samples with the monotonic time and convert
+    them when they are sent, so samples taken before the
+    synchronization get the right time once it is known.
+    Before that the current offset of the system time is
+    used.
+*/
+int64_t monotonic_to_epoch_us(int64_t monotonic);
+
+/** Get the current wall clock time in microseconds
+
+**Return**
+    Microseconds since the epoch.
+
+**Description**
+    The raw time for binary formats, the current monotonic
+    time converted with `monotonic_to_epoch_us`. Before the
+    time is synchronized with sntp this may count from 1970.
+*/
+int64_t get_epoch_us();
+
 /** Get the current system time
 
 **Requirements**
     Syncronize the time with sntp, needs wifi connection.
 
 **Parameters**
-    - buf: string buffer for the time output
+    - buf: string buffer for the time output, at least
+        `TIME_STRING_LENGTH` bytes
 
 **Description**
-    Use `time` and `localtime` to get the time and then
-    format it to YYYY-MM-DD HH:MM:SS.
+    Format the current time in UTC as ISO 8601,
+    YYYY-MM-DDTHH:MM:SSZ.
 */
 void get_time(char *buf);
 
+/** Format a point in time
+
+**Parameters**
+    - epoch: seconds since the epoch
+    - buf: string buffer for the time output
+
+**Description**
+    Format the time in UTC as ISO 8601,
+    YYYY-MM-DDTHH:MM:SSZ.
+*/
+void format_time(time_t epoch, char *buf);
+
+/** Format a point in time with fractional seconds
+
+**Parameters**
+    - epoch_us: microseconds since the epoch
+    - decimals: digits of the fraction from 0 to 6, 3 for
+        milliseconds and 6 for microseconds
+    - buf: string buffer for the time output, at least
+        `TIME_STRING_LENGTH` bytes
+
+**Return**
+    Length of the string.
+
+**Description**
+    Format the time in UTC as ISO 8601,
+    YYYY-MM-DDTHH:MM:SS.fffZ. The date is cached and only
+    recomputed when the day changes, the rest is written
+    digit by digit without `sprintf` or an allocation.
+*/
+int format_time_us(int64_t epoch_us, int decimals, char *buf);
+
 /** Get a seed for random generator initializaiton
 
 **Return**
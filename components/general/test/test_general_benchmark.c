@@ -0,0 +1,95 @@
+// MISCELLANEOUS
+// Source file of the benchmark of the time functions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../general.h"
+#include "unity.h"
+
+// calls per measurement
+#define ITERATIONS 10000
+
+// PRIVATE FUNCTIONS
+
+/** Get the time as before the cache.
+
+**Description**
+    The old `get_time` that set the time zone and used
+    `gmtime_r` and `sprintf` on every call, kept as the
+    baseline.
+*/
+static void get_time_tzset(char *buf) {
+    time_t epoch;
+    struct tm date;
+
+    time(&epoch);
+    setenv("TZ", "CET-1", 1);
+    tzset();
+    gmtime_r(&epoch, &date);
+    sprintf(buf,
+            "%04d-%02d-%02dT%02d:%02d:%02dZ",
+            date.tm_year + 1900,
+            date.tm_mon + 1,
+            date.tm_mday,
+            date.tm_hour,
+            date.tm_min,
+            date.tm_sec);
+}
+
+/** Print one result as a JSON line
+
+**Parameters**
+    - *api : name of the measured function
+    - time_us : time of all calls in microseconds
+*/
+static void print_time_result(const char *api, int64_t time_us) {
+    printf("{\"type\":\"benchmark\",\"op\":\"time\",\"api\":\"%s\","
+           "\"iterations\":%d,\"us_per_call\":%.3f}\n",
+           api, ITERATIONS, (double)time_us / ITERATIONS);
+}
+
+// TEST CASES
+
+/** Benchmark the time functions
+
+**Description**
+    Measure the time per call of `get_time` as it was with
+    `tzset` on every call against the cached formatting
+    with 0, 3 and 6 decimals and `get_epoch_us`. Print one
+    JSON line per measurement.
+*/
+TEST_CASE("time format benchmark", "[general][benchmark]") {
+    char buf[TIME_STRING_LENGTH];
+    // consumed so the calls are not optimized away
+    volatile int64_t sink = 0;
+    int64_t start;
+
+    start = get_epoch_us();
+    for (int i = 0; i < ITERATIONS; i++) {
+        get_time_tzset(buf);
+    }
+    print_time_result("get_time_tzset", get_epoch_us() - start);
+
+    start = get_epoch_us();
+    for (int i = 0; i < ITERATIONS; i++) {
+        get_time(buf);
+    }
+    print_time_result("get_time", get_epoch_us() - start);
+
+    for (int decimals = 3; decimals <= 6; decimals += 3) {
+        start = get_epoch_us();
+        for (int i = 0; i < ITERATIONS; i++) {
+            format_time_us(get_epoch_us(), decimals, buf);
+        }
+        print_time_result((decimals == 3) ? "format_time_ms" : "format_time_us",
+                          get_epoch_us() - start);
+    }
+
+    start = get_epoch_us();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink ^= get_epoch_us();
+    }
+    print_time_result("get_epoch_us", get_epoch_us() - start);
+}
@@ -3,21 +3,82 @@
 
 #include "./heartbeat.h"
 
+#include <stdarg.h>
+
+#include "../dl_wifi/dl_wifi.h"
 #include "../general/general.h"
 #include "../pl_udp/pl_udp.h"
+#include "../registry/registry.h"
+#include "../scheduler/scheduler.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// size of the heartbeat message with the full health block
+#define HEARTBEAT_LENGTH 768
 
 static const char* TAG = "heartbeat";
 
 // heartbeat period in seconds
 static uint64_t heartbeat_period = 300;
 
+// detail level of the health block
+static int32_t heartbeat_detail = HEARTBEAT_DETAIL_BASIC;
+
+// period of the health report in seconds, sent even if the
+// heartbeats are suppressed by traffic
+static uint32_t health_period = 3600;
+// handle of the health job in the scheduler, -1 before init
+int health_job = -1;
+// monotonic time of the last sent health block, 0 before
+// the first one, only used by the handler
+int64_t last_health = 0;
+
+// tasks whose stack high water marks are reported
+static const char* const health_tasks[] = {"udp-receive", "sys_evt", "esp_timer"};
+#define NUM_HEALTH_TASKS (sizeof(health_tasks) / sizeof(health_tasks[0]))
+
+// read only variables that are reported, the queue depths
+// and the counters of dropped messages
+static const char* const health_counters[] = {
+    "udp_in_flight",
+    "udp_outgoing",
+    "udp_bad_length",
+    "udp_rate_limited",
+    "udp_replayed",
+    "udp_forged",
+    "udp_fragments_dropped",
+    "udp_unacked",
+    "udp_busy",
+    "scheduler_overruns"};
+#define NUM_HEALTH_COUNTERS (sizeof(health_counters) / sizeof(health_counters[0]))
+
+// the heartbeat message, only used by the handler in the
+// task of the event loop
+char heartbeat_buffer[HEARTBEAT_LENGTH];
+
 ESP_EVENT_DEFINE_BASE(HEARTBEAT_EVENT);
 
-// handle to identify the timer
-esp_timer_handle_t heartbeat_timer;
+// handle of the job in the scheduler, -1 before init
+int heartbeat_job = -1;
 
-// function gets called when the timer runs out
+// flag if the job is running
+bool heartbeat_running = false;
+
+// function gets called when the job is due
 void heartbeat_callback() {
+    // every sent message carries the uptime and proves that
+    // the station is alive, so wait for a whole idle period
+    int64_t idle_until = pl_udp_last_sent() + heartbeat_period * 1000000;
+
+    if (idle_until > esp_timer_get_time()) {
+        ESP_LOGD(TAG, "Heartbeat suppressed by recent traffic.");
+        scheduler_postpone(heartbeat_job, idle_until);
+        return;
+    }
+
     ESP_LOGD(TAG, "Heartbeat!");
     // post a heartbeat event
     esp_event_post(HEARTBEAT_EVENT,
@@ -27,35 +88,230 @@ void heartbeat_callback() {
                    portMAX_DELAY);
 }
 
+// function gets called when the health job is due
+void health_callback() {
+    if (heartbeat_detail == HEARTBEAT_DETAIL_NONE) {
+        return;
+    }
+
+    esp_event_post(HEARTBEAT_EVENT,
+                   HEARTBEAT_EVENT_HEALTH,
+                   NULL,
+                   0,
+                   portMAX_DELAY);
+}
+
 void heartbeat_set_period(uint64_t period) {
     heartbeat_period = period;
+    if (heartbeat_job >= 0) {
+        scheduler_set_period(heartbeat_job, period);
+    }
 }
 
-void heartbeat_init() {
-    // set up the timer stuff
-    const esp_timer_create_args_t heartbeat_timer_args = {
-        .callback = &heartbeat_callback,
-        .name = "heartbeat"};
+// getters and setters of the registry entries
+int32_t heartbeat_get_running() {
+    return heartbeat_running;
+}
+
+esp_err_t heartbeat_set_running(int32_t on) {
+    if (on && !heartbeat_running) {
+        heartbeat_start();
+    } else if (!on && heartbeat_running) {
+        heartbeat_stop();
+    }
+    return ESP_OK;
+}
+
+int32_t heartbeat_get_detail() {
+    return heartbeat_detail;
+}
+
+esp_err_t heartbeat_set_detail(int32_t detail) {
+    heartbeat_detail = detail;
+    return ESP_OK;
+}
+
+int32_t heartbeat_get_period() {
+    return heartbeat_period;
+}
+
+esp_err_t heartbeat_update_period(int32_t period) {
+    // the scheduler keeps the job aligned instead of
+    // restarting it from now
+    heartbeat_set_period(period);
+    ESP_LOGI(TAG, "Updated heartbeat period to %d seconds.", period);
+    return ESP_OK;
+}
+
+int32_t health_get_period() {
+    return health_period;
+}
 
+esp_err_t health_update_period(int32_t period) {
+    health_period = period;
+    if (health_job >= 0) {
+        scheduler_set_period(health_job, period);
+    }
+    ESP_LOGI(TAG, "Updated health period to %d seconds.", period);
+    return ESP_OK;
+}
+
+static const registry_entry_t heartbeat_entry = {
+    .name = "heartbeat",
+    .type = REGISTRY_BOOL,
+    .get = heartbeat_get_running,
+    .set = heartbeat_set_running};
+
+static const registry_entry_t heartbeat_interval_entry = {
+    .name = "heartbeat_interval",
+    .type = REGISTRY_INT,
+    .min = 1,
+    .max = 86400,
+    .get = heartbeat_get_period,
+    .set = heartbeat_update_period};
+
+static const registry_entry_t heartbeat_detail_entry = {
+    .name = "heartbeat_detail",
+    .type = REGISTRY_INT,
+    .min = HEARTBEAT_DETAIL_NONE,
+    .max = HEARTBEAT_DETAIL_FULL,
+    .get = heartbeat_get_detail,
+    .set = heartbeat_set_detail};
+
+static const registry_entry_t health_interval_entry = {
+    .name = "health_interval",
+    .type = REGISTRY_INT,
+    .min = 60,
+    .max = 86400,
+    .get = health_get_period,
+    .set = health_update_period};
+
+/** Append formatted text to the heartbeat message.
+
+**Parameters**
+    - len : current length of the message
+    - *format : printf format string and its arguments
+
+**Return**
+    New length of the message, the text is cut at the end
+    of the buffer.
+*/
+int heartbeat_append(int len, const char* format, ...) {
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(heartbeat_buffer + len, HEARTBEAT_LENGTH - len, format, args);
+    va_end(args);
+
+    if (n < 0) {
+        return len;
+    }
+    return (len + n < HEARTBEAT_LENGTH) ? len + n : HEARTBEAT_LENGTH - 1;
+}
+
+/** Close an object of the heartbeat message.
+
+**Description**
+    Drop the trailing comma of the last member and append
+    the closing text.
+*/
+int heartbeat_close(int len, const char* closing) {
+    if (len > 0 && heartbeat_buffer[len - 1] == ',') {
+        len--;
+    }
+    return heartbeat_append(len, "%s", closing);
+}
+
+/** Append the health block to the heartbeat message.
+
+**Parameters**
+    - len : current length of the message
+
+**Return**
+    New length of the message.
+
+**Description**
+    Every value is a cheap read of a counter of ESP-IDF,
+    FreeRTOS or a component. The basic level has the heap,
+    the reset reason and the wifi link, the full level adds
+    the free stack of the tasks that were never used and
+    the queue depths and drop counters.
+*/
+int append_health(int len) {
+    const registry_entry_t* entry;
+    TaskHandle_t task;
+    int8_t rssi;
+
+    len = heartbeat_append(len,
+                           ",\"health\":{\"heap_free\":%u,\"heap_min\":%u,"
+                           "\"heap_largest\":%u,\"reset\":%d,\"reconnects\":%u,",
+                           esp_get_free_heap_size(),
+                           esp_get_minimum_free_heap_size(),
+                           heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                           esp_reset_reason(),
+                           dl_wifi_get_reconnects());
+    if (dl_wifi_get_rssi(&rssi) == ESP_OK) {
+        len = heartbeat_append(len, "\"rssi\":%d,", rssi);
+    }
+
+    if (heartbeat_detail >= HEARTBEAT_DETAIL_FULL) {
+        len = heartbeat_append(len, "\"stacks\":{");
+        for (int k = 0; k < NUM_HEALTH_TASKS; k++) {
+            task = xTaskGetHandle(health_tasks[k]);
+            if (task != NULL) {
+                len = heartbeat_append(len,
+                                       "\"%s\":%u,",
+                                       health_tasks[k],
+                                       uxTaskGetStackHighWaterMark(task));
+            }
+        }
+        len = heartbeat_close(len, "},\"counters\":{");
+        for (int k = 0; k < NUM_HEALTH_COUNTERS; k++) {
+            entry = registry_find(health_counters[k]);
+            if (entry != NULL && entry->get != NULL) {
+                len = heartbeat_append(len, "\"%s\":%d,", entry->name, entry->get());
+            }
+        }
+        len = heartbeat_close(len, "},");
+    }
+
+    return heartbeat_close(len, "}");
+}
+
+void heartbeat_init() {
+    log_status(TAG,
+               scheduler_add("heartbeat",
+                             heartbeat_period,
+                             &heartbeat_callback,
+                             &heartbeat_job),
+               "add heartbeat job");
     log_status(TAG,
-               esp_timer_create(&heartbeat_timer_args,
-                                &heartbeat_timer),
-               "create heartbeat timer");
+               scheduler_add("health",
+                             health_period,
+                             &health_callback,
+                             &health_job),
+               "add health job");
 
-    // setup the event stuff
+    // make the heartbeat configurable by requests
+    registry_register(&heartbeat_entry);
+    registry_register(&heartbeat_interval_entry);
+    registry_register(&heartbeat_detail_entry);
+    registry_register(&health_interval_entry);
 }
 
 void heartbeat_start() {
-    log_status(TAG,
-               esp_timer_start_periodic(heartbeat_timer,
-                                        heartbeat_period * 1000000),
-               "starting heartbeat timer");
+    scheduler_start(heartbeat_job);
+    scheduler_start(health_job);
+    heartbeat_running = true;
+    ESP_LOGV(TAG, "started heartbeat job");
 }
 
 void heartbeat_stop() {
-    log_status(TAG,
-               esp_timer_stop(heartbeat_timer),
-               "stopped heartbeat timer");
+    scheduler_stop(heartbeat_job);
+    scheduler_stop(health_job);
+    heartbeat_running = false;
+    ESP_LOGV(TAG, "stopped heartbeat job");
 }
 
 void heartbeat_handler(void* arg,
@@ -63,18 +319,33 @@ void heartbeat_handler(void* arg,
                        int32_t id,
                        void* data) {
     char time_buf[32];
-    char msg[128];
+    int64_t now = esp_timer_get_time();
+    int len;
 
     if (base == HEARTBEAT_EVENT) {
         switch (id) {
+            case HEARTBEAT_EVENT_HEALTH:
+                // a heartbeat of the same wake up may have
+                // carried the block already
+                if (last_health > 0 &&
+                    now - last_health < (int64_t)health_period * 1000000 / 2) {
+                    ESP_LOGD(TAG, "Health report sent recently.");
+                    break;
+                }
+                // fall through
             case HEARTBEAT_EVENT_SEND:
                 get_time(time_buf);
-                sprintf(msg, "{\"type\":\"heartbeat\",\"time\":\"%s\"}", time_buf);
+                len = heartbeat_append(0, "{\"type\":\"heartbeat\",\"time\":\"%s\"", time_buf);
+                if (heartbeat_detail > HEARTBEAT_DETAIL_NONE) {
+                    len = append_health(len);
+                    last_health = now;
+                }
+                heartbeat_append(len, "}");
 
-                ESP_LOGV(TAG, "%s", msg);
+                ESP_LOGV(TAG, "%s", heartbeat_buffer);
 
                 // send the heartbeat via UDP
-                pl_udp_send(msg);
+                pl_udp_send(heartbeat_buffer);
                 break;
 
             default:
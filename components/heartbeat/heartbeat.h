@@ -5,21 +5,38 @@
 #define _HEARTBEAT_H_
 
 #include "esp_event.h"
-#include "esp_timer.h"
 
 // event base
 ESP_EVENT_DECLARE_BASE(HEARTBEAT_EVENT);
 
 // event id
 typedef enum {
-    HEARTBEAT_EVENT_SEND
+    HEARTBEAT_EVENT_SEND,
+    // a heartbeat with the health block that is never
+    // suppressed by traffic
+    HEARTBEAT_EVENT_HEALTH
 } heartbeat_event_t;
 
-/** Initialize the heartbeat timer.
+// detail level of the health block of a heartbeat
+typedef enum {
+    // no health block
+    HEARTBEAT_DETAIL_NONE,
+    // heap, reset reason and wifi link
+    HEARTBEAT_DETAIL_BASIC,
+    // also stacks, queue depths and drop counters
+    HEARTBEAT_DETAIL_FULL
+} heartbeat_detail_t;
+
+/** Initialize the heartbeat job.
+
+**Requirements**
+    Initialize the scheduler first with `scheduler_init`.
 
 **Description**
-    Set the esp_timer args with the callback and a name.
-    Create the timer with `esp_timer_create`.
+    Add the heartbeat and the health report as stopped jobs
+    to the scheduler. Register the variables `heartbeat`,
+    `heartbeat_interval`, `heartbeat_detail` and
+    `health_interval`.
 */
 void heartbeat_init();
 
@@ -28,33 +45,39 @@ void heartbeat_init();
 
 **Parameters**
     - period:
-        the period of the periodic timer in seconds
+        the period of the heartbeat in seconds
 
 **Description**
-    Set the internal value for the heartbeat rate.
+    Set the internal value for the heartbeat rate. After
+    `heartbeat_init` also change the period of the job, which
+    stays aligned to the wall clock.
 */
 void heartbeat_set_period(uint64_t period);
 
-/** Start the heartbeat timer.
+/** Start the heartbeat job.
 
 **Requirements**
-    Initatilze the timer first with `heartbeat_init`.
+    Initatilze the job first with `heartbeat_init`.
 
 **Description**
-    Start the timer from `heartbeat_init` with the period
-    set by `heartbeat_set_period`.
+    Start the job from `heartbeat_init` with the period set
+    by `heartbeat_set_period`. A heartbeat is only sent after
+    a whole period without any message, otherwise the job
+    is postponed to one period after the last message.
+    Also start the health job, which sends a heartbeat with
+    the health block every `health_interval` regardless of
+    the traffic.
 */
 void heartbeat_start();
 
 
-/** Stops the heartbeat timer.
+/** Stops the heartbeat job.
 
 **Requirements**
-    Initatilze the timer first with `heartbeat_init`.
-    Call only when the timer is already running. 
+    Initatilze the job first with `heartbeat_init`.
 
 **Description**
-    Stop the running timer from `heartbeat_init`.
+    Stop the jobs from `heartbeat_init`.
 */
 void heartbeat_stop();
 
@@ -68,10 +91,15 @@ void heartbeat_stop();
 
 **Requirements**
     Handler musst be registered for base `HEARTBEAT_EVENT` 
-    and id `HEARTBEAT_EVENT_SEND` on the default event loop.
+    and the ids `HEARTBEAT_EVENT_SEND` and
+    `HEARTBEAT_EVENT_HEALTH` on the default event loop.
 
 **Description**
-    Send a heartbeat JSON object via UDP.
+    Send a heartbeat JSON object via UDP. Depending on the
+    variable `heartbeat_detail` it carries a `health` block
+    read from ESP-IDF and FreeRTOS when it is sent. A
+    health event is skipped if a heartbeat carried the
+    block within half a `health_interval`.
 */
 void heartbeat_handler(void* arg,
                        esp_event_base_t base,
@@ -0,0 +1,208 @@
+// MISCELLANEOUS
+// Source file of the logger component.
+
+#include "./logger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../general/general.h"
+#include "../registry/registry.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define LOGGER_RING_SIZE CONFIG_LOGGER_RING_SIZE
+#define LOGGER_RING_MASK (LOGGER_RING_SIZE - 1)
+
+// maximum length of a formatted line
+#define LOGGER_LINE_LENGTH 192
+// fill level of the ring that wakes the logger task before
+// the flush delay is over
+#define LOGGER_WAKE_LEVEL (LOGGER_RING_SIZE / 2)
+
+_Static_assert((LOGGER_RING_SIZE & LOGGER_RING_MASK) == 0,
+               "LOGGER_RING_SIZE must be a power of two");
+
+// a deferred log message
+typedef struct logger_entry_t {
+    // index + 1 once the entry is written, the reader waits
+    // for it because writers may finish out of order
+    uint32_t committed;
+    esp_log_level_t level;
+    // milliseconds of `esp_log_timestamp`
+    uint32_t time;
+    const char *tag;
+    const char *format;
+    uint32_t args[LOGGER_MAX_ARGS];
+} logger_entry_t;
+
+static const char *TAG = "logger";
+
+// letters of the log levels like in the ESP_LOG output
+static const char level_letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+
+static logger_entry_t ring[LOGGER_RING_SIZE];
+// index of the next entry to write, reserved by the writers
+static uint32_t head = 0;
+// index of the next entry to print, only moved by the flush
+static uint32_t tail = 0;
+
+static uint32_t num_dropped = 0;
+// dropped entries that were already reported
+static uint32_t num_reported = 0;
+
+// serializes the flushes, the writers take no lock
+static SemaphoreHandle_t flush_lock = NULL;
+// notified by the writers
+static TaskHandle_t logger_handle = NULL;
+
+// PRIVATE FUNCTIONS
+
+/** Format and print one entry.
+
+**Parameters**
+    - *entry : the entry
+*/
+void print_entry(const logger_entry_t *entry) {
+    char line[LOGGER_LINE_LENGTH];
+    const uint32_t *a = entry->args;
+    int length;
+
+    length = snprintf(line, sizeof(line), "%c (%u) %s: ",
+                      level_letters[entry->level],
+                      entry->time,
+                      entry->tag);
+    snprintf(line + length, sizeof(line) - length, entry->format,
+             a[0], a[1], a[2], a[3], a[4], a[5]);
+
+    // the runtime level of the tag applies here
+    esp_log_write(entry->level, entry->tag, "%s\n", line);
+}
+
+/** Wake the logger task.
+
+**Description**
+    Writers may run in an interrupt. The task has the lowest
+    priority, so there is no need to yield.
+*/
+void wake_logger() {
+    if (logger_handle == NULL) {
+        return;
+    }
+    if (xPortInIsrContext()) {
+        vTaskNotifyGiveFromISR(logger_handle, NULL);
+    } else {
+        xTaskNotifyGive(logger_handle);
+    }
+}
+
+/** Function of the logger task.
+
+**Description**
+    Sleep while the ring is empty. The first entry wakes the
+    task, which then collects entries for
+    `CONFIG_LOGGER_FLUSH_PERIOD` milliseconds, or until the
+    ring is half full, and flushes them at once. The task
+    has a priority just above the idle task, so the
+    formatting never delays the network or the
+    measurements.
+*/
+void logger_task(void *arg) {
+    while (1) {
+        // an entry that was still being written at the last
+        // flush gave no notification
+        if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        ulTaskNotifyTake(pdTRUE, CONFIG_LOGGER_FLUSH_PERIOD / portTICK_PERIOD_MS);
+        logger_flush();
+    }
+}
+
+// getter of the registry entry
+int32_t logger_get_dropped() {
+    return __atomic_load_n(&num_dropped, __ATOMIC_RELAXED);
+}
+
+static const registry_entry_t logger_dropped_entry = {
+    .name = "log_dropped",
+    .type = REGISTRY_INT,
+    .get = logger_get_dropped};
+
+// PUBLIC FUNCTIONS
+
+void logger_init() {
+    flush_lock = xSemaphoreCreateMutex();
+    if (pdPASS != xTaskCreate(logger_task,
+                              "logger",
+                              3072,
+                              NULL,
+                              tskIDLE_PRIORITY + 1,
+                              &logger_handle)) {
+        ESP_LOGE(TAG, "unable to create the logger task");
+    }
+
+    registry_register(&logger_dropped_entry);
+}
+
+void logger_write(esp_log_level_t level,
+                  const char *tag,
+                  const char *format,
+                  const uint32_t *args) {
+    logger_entry_t *entry;
+    uint32_t index = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    uint32_t fill;
+
+    // reserve an entry, retry if another writer was faster
+    do {
+        if (index - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= LOGGER_RING_SIZE) {
+            __atomic_fetch_add(&num_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&head, &index, index + 1, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    entry = &ring[index & LOGGER_RING_MASK];
+    entry->level = level;
+    entry->time = esp_log_timestamp();
+    entry->tag = tag;
+    entry->format = format;
+    memcpy(entry->args, args, sizeof(entry->args));
+    __atomic_store_n(&entry->committed, index + 1, __ATOMIC_RELEASE);
+
+    // the tail cannot pass this entry before it was written,
+    // so the first entry of an empty ring always notifies
+    fill = index + 1 - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    if (fill == 1 || fill >= LOGGER_WAKE_LEVEL) {
+        wake_logger();
+    }
+}
+
+void logger_flush() {
+    logger_entry_t *entry;
+    uint32_t dropped;
+
+    if (flush_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+    while (tail != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+        entry = &ring[tail & LOGGER_RING_MASK];
+        if (__atomic_load_n(&entry->committed, __ATOMIC_ACQUIRE) != tail + 1) {
+            // still being written, print it on the next flush
+            break;
+        }
+        print_entry(entry);
+        // free the entry for the writers
+        __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    dropped = __atomic_load_n(&num_dropped, __ATOMIC_RELAXED);
+    if (dropped != num_reported) {
+        ESP_LOGW(TAG, "dropped %u log entries", dropped - num_reported);
+        num_reported = dropped;
+    }
+    xSemaphoreGive(flush_lock);
+}
@@ -0,0 +1,87 @@
+// MISCELLANEOUS
+// Header file of the logger component.
+
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// maximum number of arguments of a deferred log
+#define LOGGER_MAX_ARGS 6
+
+/** Log a message later.
+
+**Parameters**
+    - level : log level of the message
+    - *tag : tag of the component, a static string
+    - *format : format string, a literal
+    - ... : at most `LOGGER_MAX_ARGS` integer arguments
+
+**Description**
+    Like `ESP_LOG_LEVEL_LOCAL` the call compiles to nothing
+    if the level is above the `LOG_LOCAL_LEVEL` of the file.
+    Otherwise only the pointers, the timestamp and the raw
+    arguments are stored, the formatting happens later in
+    the logger task. The arguments are converted to 32 bit
+    integers, so pass floats scaled to integers and no
+    strings that may change before they are printed.
+*/
+#define LOGGER_LEVEL(level, tag, format, ...)                           \
+    do {                                                                \
+        if (LOG_LOCAL_LEVEL >= (level)) {                               \
+            logger_write((level), (tag), (format),                      \
+                         (const uint32_t[LOGGER_MAX_ARGS]){__VA_ARGS__}); \
+        }                                                               \
+    } while (0)
+
+// deferred versions of the ESP_LOG macros
+#define LOGGER_E(tag, format, ...) LOGGER_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define LOGGER_W(tag, format, ...) LOGGER_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define LOGGER_I(tag, format, ...) LOGGER_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define LOGGER_D(tag, format, ...) LOGGER_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define LOGGER_V(tag, format, ...) LOGGER_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+/** Initialize the logger.
+
+**Description**
+    Create the low priority task that formats the entries
+    of the ring at most `CONFIG_LOGGER_FLUSH_PERIOD`
+    milliseconds after the first one and register the read
+    only variable `log_dropped`. Entries written before are
+    kept.
+*/
+void logger_init();
+
+/** Store a log entry in the ring.
+
+**Parameters**
+    - level : log level of the message
+    - *tag : tag of the component
+    - *format : format string
+    - *args : `LOGGER_MAX_ARGS` arguments
+
+**Description**
+    Use the `LOGGER_*` macros instead. The ring takes no
+    lock, so any task or interrupt may write. The entry is
+    dropped and counted if the ring is full. The first entry
+    of an empty ring and entries of a ring that is half
+    full notify the logger task.
+*/
+void logger_write(esp_log_level_t level,
+                  const char *tag,
+                  const char *format,
+                  const uint32_t *args);
+
+/** Format and print all entries of the ring.
+
+**Description**
+    Called by the logger task. Call it before a restart so
+    no entry gets lost. Flushes of several tasks are done
+    one after the other.
+*/
+void logger_flush();
+
+#endif  // _LOGGER_H_
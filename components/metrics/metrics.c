@@ -0,0 +1,132 @@
+// MISCELLANEOUS
+// Source file of the metrics component.
+
+#include "./metrics.h"
+
+#include <string.h>
+
+#include "../general/general.h"
+#include "../registry/registry.h"
+#include "freertos/FreeRTOS.h"
+
+// histogram of the durations of a stage
+typedef struct histogram_t {
+    uint32_t buckets[METRICS_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} histogram_t;
+
+static const char *TAG = "metrics";
+
+static const char *const stage_names[METRICS_NUM_STAGES] = {
+    [METRICS_DECRYPT] = "decrypt",
+    [METRICS_QUEUE] = "queue",
+    [METRICS_PARSE] = "parse",
+    [METRICS_HANDLE] = "handle",
+    [METRICS_CONVERSION] = "conversion",
+    [METRICS_ENCRYPT] = "encrypt",
+    [METRICS_SEND] = "send",
+    [METRICS_TOTAL] = "total"};
+
+// histograms of all stages, recorded from several tasks
+static histogram_t histograms[METRICS_NUM_STAGES];
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// PRIVATE FUNCTIONS
+
+/** Get the duration of a percentile.
+
+**Parameters**
+    - *histogram : copy of the histogram
+    - percent : the percentile from 1 to 100
+
+**Return**
+    Upper bound of the bucket holding the percentile, at
+    most the maximum.
+*/
+uint32_t percentile(const histogram_t *histogram, uint32_t percent) {
+    // rank of the percentile, at least 1
+    uint32_t rank = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    uint32_t bound;
+
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += histogram->buckets[b];
+        if (seen >= rank) {
+            bound = (b == 0) ? 0 : (uint32_t)((1ull << b) - 1);
+            return (bound < histogram->max) ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// setter of the registry entry
+esp_err_t metrics_reset(int32_t on) {
+    if (on) {
+        portENTER_CRITICAL(&metrics_lock);
+        memset(histograms, 0, sizeof(histograms));
+        portEXIT_CRITICAL(&metrics_lock);
+        ESP_LOGI(TAG, "cleared the histograms");
+    }
+    return ESP_OK;
+}
+
+static const registry_entry_t metrics_reset_entry = {
+    .name = "metrics_reset",
+    .type = REGISTRY_BOOL,
+    .set = metrics_reset};
+
+// PUBLIC FUNCTIONS
+
+void metrics_init() {
+    registry_register(&metrics_reset_entry);
+}
+
+void metrics_record(metrics_stage_t stage, int64_t duration) {
+    uint32_t value;
+    int bucket;
+
+    if (duration < 0) {
+        duration = 0;
+    } else if (duration > UINT32_MAX) {
+        duration = UINT32_MAX;
+    }
+    value = (uint32_t)duration;
+    // index of the highest set bit + 1, 0 for 0
+    bucket = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= METRICS_BUCKETS) {
+        bucket = METRICS_BUCKETS - 1;
+    }
+
+    portENTER_CRITICAL(&metrics_lock);
+    histograms[stage].buckets[bucket]++;
+    histograms[stage].count++;
+    if (value > histograms[stage].max) {
+        histograms[stage].max = value;
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_summarize(metrics_stage_t stage, metrics_summary_t *summary) {
+    histogram_t histogram;
+
+    // consistent copy, the percentiles are computed outside
+    // of the critical section
+    portENTER_CRITICAL(&metrics_lock);
+    histogram = histograms[stage];
+    portEXIT_CRITICAL(&metrics_lock);
+
+    summary->count = histogram.count;
+    summary->max = histogram.max;
+    if (histogram.count == 0) {
+        summary->p50 = summary->p90 = summary->p99 = 0;
+        return;
+    }
+    summary->p50 = percentile(&histogram, 50);
+    summary->p90 = percentile(&histogram, 90);
+    summary->p99 = percentile(&histogram, 99);
+}
+
+const char *metrics_stage_name(metrics_stage_t stage) {
+    return stage_names[stage];
+}
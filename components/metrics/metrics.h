@@ -0,0 +1,84 @@
+// MISCELLANEOUS
+// Header file of the metrics component.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+
+// number of buckets of a histogram, bucket b > 0 counts the
+// durations from 2^(b-1) to 2^b - 1 microseconds
+#define METRICS_BUCKETS 32
+
+// stages of a request from its arrival to its reply
+typedef enum {
+    // decryption of one frame
+    METRICS_DECRYPT,
+    // from the arrival of the last frame of a message to the
+    // start of its handler
+    METRICS_QUEUE,
+    // tokenizing the JSON text
+    METRICS_PARSE,
+    // executing the requests and formatting the reply
+    METRICS_HANDLE,
+    // conversion of the BMP180 over I2C
+    METRICS_CONVERSION,
+    // encryption of one frame
+    METRICS_ENCRYPT,
+    // `sendto` of one frame
+    METRICS_SEND,
+    // from the arrival of a message to its reply
+    METRICS_TOTAL,
+    METRICS_NUM_STAGES
+} metrics_stage_t;
+
+// percentiles of a stage in microseconds, each is the upper
+// bound of its bucket but at most the maximum
+typedef struct metrics_summary_t {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} metrics_summary_t;
+
+/** Initialize the metrics.
+
+**Description**
+    Register the write only variable `metrics_reset` which
+    clears all histograms when it is set to `on`.
+*/
+void metrics_init();
+
+/** Record the duration of a stage.
+
+**Parameters**
+    - stage : the stage
+    - duration : duration in microseconds, e.g. the
+        difference of two `esp_timer_get_time`
+
+**Description**
+    Count the duration in the log2 bucket of the histogram
+    of the stage. Constant time and safe from any task.
+*/
+void metrics_record(metrics_stage_t stage, int64_t duration);
+
+/** Summarize the histogram of a stage.
+
+**Parameters**
+    - stage : the stage
+    - *summary : output for the summary
+*/
+void metrics_summarize(metrics_stage_t stage, metrics_summary_t *summary);
+
+/** Get the name of a stage.
+
+**Parameters**
+    - stage : the stage
+
+**Return**
+    Name of the stage for the `metrics` reply.
+*/
+const char *metrics_stage_name(metrics_stage_t stage);
+
+#endif  // _METRICS_H_
@@ -1,9 +1,13 @@
 // PROTOCOL LAYER
 // Source file of the I2C component.
 
+// compile time log level of this hot path, see general.h
+#define LOG_COMPONENT_LEVEL CONFIG_LOG_LEVEL_PL_I2C
+
 // components
 #include "./pl_i2c.h"
 #include "../general/general.h"
+#include "../logger/logger.h"
 
 // esp-idf
 #include "driver/i2c.h"
@@ -71,12 +75,11 @@ esp_err_t pl_i2c_write(uint8_t slave_addr,
     // delete command link
     i2c_cmd_link_delete(cmd_link);
 
-    ESP_LOGV(TAG,
-             "master write to 0x%02X: \n bytes:",
-             slave_addr);
-    for (int i = 0; i < length; i++) {
-        ESP_LOGV(TAG, "0x%02X", bytes[i]);
-    }
+    LOGGER_V(TAG,
+             "master write to 0x%02X: %d bytes, first 0x%02X",
+             slave_addr,
+             length,
+             length > 0 ? bytes[0] : 0);
 
     // return the status of the execution of the command
     // link
@@ -110,7 +113,7 @@ uint8_t pl_i2c_read(uint8_t slave_addr) {
     // delete command link
     i2c_cmd_link_delete(cmd_link);
 
-    ESP_LOGV(TAG,
+    LOGGER_V(TAG,
              "master read from 0x%02X: byte: 0x%02X",
              slave_addr,
              byte);
@@ -0,0 +1,469 @@
+// PROTOCOL LAYER
+// Source file of the JSON component.
+
+#include "./pl_json.h"
+
+#include <string.h>
+
+// what the tokenizer expects next
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_COMMA,
+    EXPECT_END
+} expect_t;
+
+// PRIVATE FUNCTIONS
+
+/** Get a new token from the array.
+
+**Return**
+    Pointer to the token or NULL if the array is full.
+*/
+pl_json_token_t *new_token(pl_json_t *doc,
+                           int max_tokens,
+                           pl_json_type_t type,
+                           int start,
+                           int parent) {
+    pl_json_token_t *token;
+
+    if (doc->num_tokens >= max_tokens) {
+        return NULL;
+    }
+    token = &doc->tokens[doc->num_tokens++];
+    token->type = type;
+    token->start = start;
+    token->end = -1;
+    token->size = 0;
+    token->parent = parent;
+    return token;
+}
+
+/** Find the end of a string.
+
+**Parameters**
+    - *json : the text
+    - len : length of the text
+    - pos : position of the opening quote
+
+**Return**
+    Position of the closing quote or a negative error code.
+*/
+int scan_string(const char *json, int len, int pos) {
+    for (pos++; pos < len && json[pos] != '\0'; pos++) {
+        char c = json[pos];
+
+        if (c == '"') {
+            return pos;
+        } else if ((unsigned char)c < 0x20) {
+            return PL_JSON_ERROR_INVALID;
+        } else if (c == '\\') {
+            pos++;
+            if (pos >= len) {
+                break;
+            }
+            if (json[pos] == 'u') {
+                // four hex digits must follow
+                for (int i = 0; i < 4; i++) {
+                    pos++;
+                    if (pos >= len || !strchr("0123456789abcdefABCDEF", json[pos]) ||
+                        json[pos] == '\0') {
+                        return pos >= len ? PL_JSON_ERROR_PARTIAL : PL_JSON_ERROR_INVALID;
+                    }
+                }
+            } else if (json[pos] == '\0' || !strchr("\"\\/bfnrt", json[pos])) {
+                return PL_JSON_ERROR_INVALID;
+            }
+        }
+    }
+    return PL_JSON_ERROR_PARTIAL;
+}
+
+/** Get the error of a primitive that stops short.
+
+**Return**
+    `PL_JSON_ERROR_PARTIAL` at the end of the text,
+    `PL_JSON_ERROR_INVALID` otherwise.
+*/
+int primitive_error(const char *json, int len, int pos) {
+    return (pos >= len || json[pos] == '\0') ? PL_JSON_ERROR_PARTIAL : PL_JSON_ERROR_INVALID;
+}
+
+/** Skip the digits at a position.
+
+**Return**
+    Position after the last digit.
+*/
+int skip_digits(const char *json, int len, int pos) {
+    while (pos < len && json[pos] >= '0' && json[pos] <= '9') {
+        pos++;
+    }
+    return pos;
+}
+
+/** Find the end of a number.
+
+**Parameters**
+    - *json : the text
+    - len : length of the text
+    - pos : position of the first character
+
+**Return**
+    Position after the last character or a negative error
+    code.
+
+**Description**
+    The grammar of JSON,
+    `-?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?`.
+*/
+int scan_number(const char *json, int len, int pos) {
+    int start;
+
+    if (pos < len && json[pos] == '-') {
+        pos++;
+    }
+    // no leading zeros
+    if (pos < len && json[pos] == '0') {
+        pos++;
+    } else {
+        start = pos;
+        pos = skip_digits(json, len, pos);
+        if (pos == start) {
+            return primitive_error(json, len, pos);
+        }
+    }
+    if (pos < len && json[pos] == '.') {
+        start = ++pos;
+        pos = skip_digits(json, len, pos);
+        if (pos == start) {
+            return primitive_error(json, len, pos);
+        }
+    }
+    if (pos < len && (json[pos] == 'e' || json[pos] == 'E')) {
+        pos++;
+        if (pos < len && (json[pos] == '+' || json[pos] == '-')) {
+            pos++;
+        }
+        start = pos;
+        pos = skip_digits(json, len, pos);
+        if (pos == start) {
+            return primitive_error(json, len, pos);
+        }
+    }
+    return pos;
+}
+
+/** Find the end of a primitive.
+
+**Parameters**
+    - *json : the text
+    - len : length of the text
+    - pos : position of the first character
+
+**Return**
+    Position after the last character or a negative error
+    code.
+
+**Description**
+    A primitive is exactly `true`, `false`, `null` or a
+    number and ends at whitespace, a comma, a closing
+    bracket or the end of the text.
+*/
+int scan_primitive(const char *json, int len, int pos) {
+    const char *literal = NULL;
+
+    switch (json[pos]) {
+        case 't':
+            literal = "true";
+            break;
+        case 'f':
+            literal = "false";
+            break;
+        case 'n':
+            literal = "null";
+            break;
+        default:
+            pos = scan_number(json, len, pos);
+            if (pos < 0) {
+                return pos;
+            }
+    }
+
+    for (; literal != NULL && *literal != '\0'; literal++, pos++) {
+        if (pos >= len || json[pos] == '\0') {
+            return PL_JSON_ERROR_PARTIAL;
+        }
+        if (json[pos] != *literal) {
+            return PL_JSON_ERROR_INVALID;
+        }
+    }
+
+    if (pos < len && json[pos] != '\0' && !strchr(" \t\r\n,]}", json[pos])) {
+        return PL_JSON_ERROR_INVALID;
+    }
+    return pos;
+}
+
+// PUBLIC FUNCTIONS
+
+int pl_json_parse(pl_json_t *doc,
+                  char *json,
+                  int len,
+                  pl_json_token_t *tokens,
+                  int max_tokens) {
+    // token the next value belongs to, a container or a key
+    int super = -1;
+    expect_t expect = EXPECT_VALUE;
+    // a container was just opened and may be closed again
+    bool empty = false;
+    pl_json_token_t *token;
+    int pos, end;
+    char c;
+
+    doc->json = json;
+    doc->tokens = tokens;
+    doc->num_tokens = 0;
+
+    // offsets are stored in 16 bits
+    if (len > INT16_MAX) {
+        return PL_JSON_ERROR_NOMEM;
+    }
+
+    for (pos = 0; pos < len && json[pos] != '\0'; pos++) {
+        c = json[pos];
+
+        switch (c) {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                continue;
+
+            case '{':
+            case '[':
+                if (expect != EXPECT_VALUE) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                token = new_token(doc, max_tokens,
+                                  (c == '{') ? PL_JSON_OBJECT : PL_JSON_ARRAY,
+                                  pos, super);
+                if (token == NULL) {
+                    return PL_JSON_ERROR_NOMEM;
+                }
+                if (super != -1) {
+                    tokens[super].size++;
+                }
+                super = doc->num_tokens - 1;
+                expect = (c == '{') ? EXPECT_KEY : EXPECT_VALUE;
+                empty = true;
+                continue;
+
+            case '}':
+            case ']':
+                if (super == -1 ||
+                    tokens[super].type != ((c == '}') ? PL_JSON_OBJECT : PL_JSON_ARRAY) ||
+                    !(expect == EXPECT_COMMA || empty)) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                tokens[super].end = pos + 1;
+                super = tokens[super].parent;
+                break;
+
+            case ':':
+                if (expect != EXPECT_COLON) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                expect = EXPECT_VALUE;
+                continue;
+
+            case ',':
+                if (expect != EXPECT_COMMA) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                expect = (tokens[super].type == PL_JSON_OBJECT) ? EXPECT_KEY : EXPECT_VALUE;
+                empty = false;
+                continue;
+
+            case '"':
+                if (expect != EXPECT_VALUE && expect != EXPECT_KEY) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                end = scan_string(json, len, pos);
+                if (end < 0) {
+                    return end;
+                }
+                token = new_token(doc, max_tokens, PL_JSON_STRING, pos + 1, super);
+                if (token == NULL) {
+                    return PL_JSON_ERROR_NOMEM;
+                }
+                token->end = end;
+                if (super != -1) {
+                    tokens[super].size++;
+                }
+                pos = end;
+                empty = false;
+                if (expect == EXPECT_KEY) {
+                    // the value of the key becomes its child
+                    super = doc->num_tokens - 1;
+                    expect = EXPECT_COLON;
+                    continue;
+                }
+                break;
+
+            default:
+                if (expect != EXPECT_VALUE) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+                end = scan_primitive(json, len, pos);
+                if (end < 0) {
+                    return end;
+                }
+                token = new_token(doc, max_tokens, PL_JSON_PRIMITIVE, pos, super);
+                if (token == NULL) {
+                    return PL_JSON_ERROR_NOMEM;
+                }
+                token->end = end;
+                if (super != -1) {
+                    tokens[super].size++;
+                }
+                pos = end - 1;
+                empty = false;
+                break;
+        }
+
+        // a value was completed
+        if (super == -1) {
+            expect = EXPECT_END;
+        } else {
+            if (tokens[super].type == PL_JSON_STRING) {
+                // return from the key to its object
+                super = tokens[super].parent;
+            }
+            expect = EXPECT_COMMA;
+        }
+        empty = false;
+
+        if (expect == EXPECT_END) {
+            // only white space may follow the root value
+            for (pos++; pos < len && json[pos] != '\0'; pos++) {
+                if (!strchr(" \t\r\n", json[pos])) {
+                    return PL_JSON_ERROR_INVALID;
+                }
+            }
+            break;
+        }
+    }
+
+    if (doc->num_tokens == 0 || expect != EXPECT_END) {
+        return PL_JSON_ERROR_PARTIAL;
+    }
+    return doc->num_tokens;
+}
+
+int pl_json_next(const pl_json_t *doc, int index) {
+    const pl_json_token_t *token = &doc->tokens[index];
+    int next = index + 1;
+
+    if (token->type == PL_JSON_OBJECT || token->type == PL_JSON_ARRAY) {
+        // skip all tokens inside the container
+        while (next < doc->num_tokens && doc->tokens[next].start < token->end) {
+            next++;
+        }
+    } else if (token->type == PL_JSON_STRING && token->size == 1 && next < doc->num_tokens) {
+        // skip the value of a key
+        next = pl_json_next(doc, next);
+    }
+    return next;
+}
+
+void pl_json_extract(const pl_json_t *doc,
+                     int object,
+                     const char *const *keys,
+                     int *values,
+                     int num_keys) {
+    int member;
+    int num_members;
+
+    for (int k = 0; k < num_keys; k++) {
+        values[k] = -1;
+    }
+
+    if (!pl_json_is(doc, object, PL_JSON_OBJECT)) {
+        return;
+    }
+
+    member = object + 1;
+    num_members = doc->tokens[object].size;
+    for (int m = 0; m < num_members && member < doc->num_tokens; m++) {
+        for (int k = 0; k < num_keys; k++) {
+            if (values[k] == -1 && pl_json_equals(doc, member, keys[k])) {
+                values[k] = member + 1;
+                break;
+            }
+        }
+        member = pl_json_next(doc, member);
+    }
+}
+
+bool pl_json_is(const pl_json_t *doc, int index, pl_json_type_t type) {
+    return index >= 0 && index < doc->num_tokens && doc->tokens[index].type == type;
+}
+
+bool pl_json_equals(const pl_json_t *doc, int index, const char *string) {
+    int len;
+
+    if (!pl_json_is(doc, index, PL_JSON_STRING)) {
+        return false;
+    }
+    len = doc->tokens[index].end - doc->tokens[index].start;
+    return strlen(string) == len &&
+           0 == memcmp(doc->json + doc->tokens[index].start, string, len);
+}
+
+char *pl_json_string(const pl_json_t *doc, int index) {
+    if (!pl_json_is(doc, index, PL_JSON_STRING)) {
+        return NULL;
+    }
+    // replace the closing quote
+    doc->json[doc->tokens[index].end] = '\0';
+    return doc->json + doc->tokens[index].start;
+}
+
+bool pl_json_int(const pl_json_t *doc, int index, int32_t *value) {
+    const char *c;
+    const char *end;
+    bool negative;
+    int64_t result = 0;
+
+    if (!pl_json_is(doc, index, PL_JSON_PRIMITIVE)) {
+        return false;
+    }
+
+    c = doc->json + doc->tokens[index].start;
+    end = doc->json + doc->tokens[index].end;
+    negative = (*c == '-');
+    if (negative) {
+        c++;
+    }
+    if (c == end) {
+        return false;
+    }
+
+    for (; c < end; c++) {
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        result = result * 10 + (*c - '0');
+        if (result > (int64_t)INT32_MAX + 1) {
+            return false;
+        }
+    }
+
+    result = negative ? -result : result;
+    if (result > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)result;
+    return true;
+}
@@ -0,0 +1,149 @@
+// PROTOCOL LAYER
+// Header file of the JSON component.
+
+#ifndef _PL_JSON_H_
+#define _PL_JSON_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// errors returned by `pl_json_parse`
+#define PL_JSON_ERROR_NOMEM -1
+#define PL_JSON_ERROR_INVALID -2
+#define PL_JSON_ERROR_PARTIAL -3
+
+// type of a token
+typedef enum {
+    PL_JSON_UNDEFINED,
+    PL_JSON_OBJECT,
+    PL_JSON_ARRAY,
+    PL_JSON_STRING,
+    PL_JSON_PRIMITIVE
+} pl_json_type_t;
+
+// one token of the parsed text. start and end are offsets
+// into the text, for strings without the quotes. size is
+// the number of members of an object, the number of
+// elements of an array and 1 for a key with its value.
+typedef struct pl_json_token_t {
+    int16_t start;
+    int16_t end;
+    int16_t size;
+    int16_t parent;
+    uint8_t type;
+} pl_json_token_t;
+
+// parsed document, a view on the text and its tokens
+typedef struct pl_json_t {
+    char *json;
+    pl_json_token_t *tokens;
+    int num_tokens;
+} pl_json_t;
+
+/** Tokenize a JSON text.
+
+**Parameters**
+    - *doc : document that is filled with the result
+    - *json : the text, it is modified by `pl_json_string`
+    - len : length of the text in bytes
+    - *tokens : caller owned array for the tokens
+    - max_tokens : number of elements of `tokens`
+
+**Return**
+    - number of tokens or one of the negative
+        `PL_JSON_ERROR_*` codes
+
+**Description**
+    Single pass tokenizer in the style of jsmn. No memory is
+    allocated, the tokens only refer to offsets in the text.
+    Token 0 is the root value. Structural errors like
+    unbalanced brackets or keys that are no strings are
+    rejected, as are primitives other than `true`, `false`,
+    `null` and the numbers of the JSON grammar.
+*/
+int pl_json_parse(pl_json_t *doc,
+                  char *json,
+                  int len,
+                  pl_json_token_t *tokens,
+                  int max_tokens);
+
+/** Get the index of the next sibling of a token.
+
+**Parameters**
+    - *doc : parsed document
+    - index : index of the token
+
+**Return**
+    Index of the first token after the value and all of its
+    children.
+*/
+int pl_json_next(const pl_json_t *doc, int index);
+
+/** Look up the values of several keys of an object.
+
+**Parameters**
+    - *doc : parsed document
+    - object : index of the object token
+    - *keys : array of `num_keys` key strings
+    - *values : output array of `num_keys` value indices
+    - num_keys : number of keys
+
+**Description**
+    Walk the members of the object once and store the index
+    of the value of each key in `values`. Keys that are not
+    present get the index -1.
+*/
+void pl_json_extract(const pl_json_t *doc,
+                     int object,
+                     const char *const *keys,
+                     int *values,
+                     int num_keys);
+
+/** Check the type of a token.
+
+**Parameters**
+    - *doc : parsed document
+    - index : index of the token, may be -1
+    - type : the expected type
+
+**Return**
+    True if the token exists and has the type.
+*/
+bool pl_json_is(const pl_json_t *doc, int index, pl_json_type_t type);
+
+/** Compare a string token with a C string.
+
+**Return**
+    True if the token is a string equal to `string`.
+*/
+bool pl_json_equals(const pl_json_t *doc, int index, const char *string);
+
+/** Get a string token as a C string.
+
+**Parameters**
+    - *doc : parsed document
+    - index : index of the token
+
+**Return**
+    Pointer into the text or NULL if the token is no string.
+
+**Description**
+    Terminate the string in place by replacing the closing
+    quote with a null character. Escape sequences are not
+    decoded.
+*/
+char *pl_json_string(const pl_json_t *doc, int index);
+
+/** Get a number token as an integer.
+
+**Parameters**
+    - *doc : parsed document
+    - index : index of the token
+    - *value : output for the value
+
+**Return**
+    True if the token is an integer number that fits.
+*/
+bool pl_json_int(const pl_json_t *doc, int index, int32_t *value);
+
+#endif  // _PL_JSON_H_
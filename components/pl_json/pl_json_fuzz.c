@@ -0,0 +1,98 @@
+// PROTOCOL LAYER
+// Source file of the fuzz target of the JSON component.
+//
+// Host only, it is not part of the component build. Build
+// it with pl_json.c and -fsanitize=fuzzer,address,undefined
+// of clang and run it with -max_len=256 on a corpus
+// directory and the seeds in fuzz_seeds.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./pl_json.h"
+
+// like the receive buffer and the tokens of the weather
+// station, a small token array also hits PL_JSON_ERROR_NOMEM
+#define MAX_LENGTH 1024
+#define MAX_TOKENS 64
+
+static const char *const keys[] = {"type", "id", "quantity", "name", "value"};
+#define NUM_KEYS (sizeof(keys) / sizeof(keys[0]))
+
+/** Stop the fuzzer if a condition does not hold */
+void check(int condition) {
+    if (!condition) {
+        abort();
+    }
+}
+
+/** Check the tokens of a parsed text.
+
+**Parameters**
+    - *doc : parsed document
+    - len : length of the text in bytes
+
+**Description**
+    Every token lies inside the text and after its parent,
+    the siblings of the root end at the last token. Then
+    run the typed layer over all tokens like the weather
+    station does on its fields.
+*/
+void check_tokens(const pl_json_t *doc, int len) {
+    const pl_json_token_t *token;
+    int values[NUM_KEYS];
+    int32_t value;
+
+    check(pl_json_next(doc, 0) == doc->num_tokens);
+    for (int i = 0; i < doc->num_tokens; i++) {
+        token = &doc->tokens[i];
+        check(token->start >= 0 && token->start <= token->end && token->end <= len);
+        check(token->parent < i && (i == 0) == (token->parent < 0));
+        check(pl_json_next(doc, i) > i && pl_json_next(doc, i) <= doc->num_tokens);
+    }
+
+    for (int i = 0; i < doc->num_tokens; i++) {
+        if (pl_json_is(doc, i, PL_JSON_OBJECT)) {
+            pl_json_extract(doc, i, keys, values, NUM_KEYS);
+            for (int k = 0; k < NUM_KEYS; k++) {
+                check(values[k] < doc->num_tokens);
+            }
+        }
+        pl_json_equals(doc, i, "get");
+        pl_json_int(doc, i, &value);
+    }
+    // terminates the strings in place, so last
+    for (int i = 0; i < doc->num_tokens; i++) {
+        if (pl_json_is(doc, i, PL_JSON_STRING)) {
+            check(pl_json_string(doc, i) != NULL);
+        }
+    }
+}
+
+// PUBLIC FUNCTIONS
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    pl_json_token_t tokens[MAX_TOKENS];
+    char text[MAX_LENGTH + 1];
+    pl_json_t doc;
+    int num_tokens;
+
+    if (size > MAX_LENGTH) {
+        return 0;
+    }
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    // the small array reports missing tokens, the full one
+    // parses the same text
+    num_tokens = pl_json_parse(&doc, text, size, tokens, 4);
+    check(num_tokens != 0 && num_tokens <= 4);
+    num_tokens = pl_json_parse(&doc, text, size, tokens, MAX_TOKENS);
+    check(num_tokens != 0 && num_tokens <= MAX_TOKENS);
+    if (num_tokens > 0) {
+        check(doc.num_tokens == num_tokens);
+        check_tokens(&doc, size);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// PROTOCOL LAYER
+// Source file of the tests of the JSON component.
+
+#include <string.h>
+
+#include "../pl_json.h"
+#include "unity.h"
+
+#define MAX_TOKENS 16
+#define MAX_LENGTH 64
+
+// PRIVATE FUNCTIONS
+
+/** Parse a text
+
+**Parameters**
+    - *text : the text, copied because the tokenizer may
+        modify it
+
+**Return**
+    Number of tokens or a negative error code.
+*/
+static int parse(const char *text) {
+    pl_json_token_t tokens[MAX_TOKENS];
+    char json[MAX_LENGTH];
+    pl_json_t doc;
+
+    strcpy(json, text);
+    return pl_json_parse(&doc, json, strlen(json), tokens, MAX_TOKENS);
+}
+
+// TEST CASES
+
+/** Test the literals.
+
+**Description**
+    Only the exact words are primitives, a prefix at the end
+    of the text is partial.
+*/
+TEST_CASE("JSON literals", "[pl_json]") {
+    TEST_ASSERT_EQUAL(1, parse("true"));
+    TEST_ASSERT_EQUAL(1, parse("false"));
+    TEST_ASSERT_EQUAL(1, parse("null"));
+    TEST_ASSERT_EQUAL(4, parse("[true,false,null]"));
+
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_PARTIAL, parse("nul"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("tx"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("nulls"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("True"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("{\"a\":tx}"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("{\"a\":nul}"));
+}
+
+/** Test the number grammar.
+
+**Description**
+    Signs only lead the number and the exponent, no leading
+    zeros and digits on both sides of the point.
+*/
+TEST_CASE("JSON numbers", "[pl_json]") {
+    const char *const valid[] = {
+        "0", "-0", "7", "-12", "600", "1.5", "-0.25", "1e3", "2E-3", "1.5e+10"};
+    const char *const invalid[] = {
+        "1-2", "01", "-01", "+1", ".5", "1.e3", "--1", "1e3.5", "0x10", "7x", "1E"};
+
+    for (int i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(1, parse(valid[i]), valid[i]);
+    }
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        TEST_ASSERT_TRUE_MESSAGE(parse(invalid[i]) < 0, invalid[i]);
+    }
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_PARTIAL, parse("-"));
+    TEST_ASSERT_EQUAL(PL_JSON_ERROR_INVALID, parse("{\"id\":1-2}"));
+    TEST_ASSERT_EQUAL(5, parse("{\"id\":-7,\"window\":600}"));
+    TEST_ASSERT_EQUAL(4, parse("[1, -2.5e3 ,0]"));
+}
@@ -0,0 +1,180 @@
+// PROTOCOL LAYER
+// Source file of the benchmark of the JSON component.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../pl_json.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "unity.h"
+
+// replays of the whole corpus per measurement
+#define ITERATIONS 1000
+// tokens per message like the weather station
+#define MAX_TOKENS 64
+#define MAX_LENGTH 256
+
+// commands of the weather station protocol
+static const char *const valid[] = {
+    "{\"type\":\"get\",\"quantity\":\"temperature\"}",
+    "{\"type\":\"get\",\"quantity\":[\"temperature\",\"pressure\"],\"id\":7}",
+    "{\"type\":\"get\",\"quantity\":\"pressure\",\"window\":600,\"aggregate\":\"mean\"}",
+    "{\"type\":\"get\",\"quantity\":\"temperature\",\"max_age\":30}",
+    "{\"type\":\"set\",\"name\":\"heartbeat\",\"value\":\"on\"}",
+    "{\"type\":\"set\",\"name\":\"key\",\"value\":\"1:00112233445566778899aabbccddeeff"
+    "00112233445566778899aabbccddeeff\"}",
+    "[{\"type\":\"set\",\"name\":\"heartbeat\",\"value\":\"on\"},"
+    "{\"type\":\"get\",\"quantity\":\"pressure\",\"window\":600}]",
+    "{\"type\":\"time\"}"};
+
+// rejected by the tokenizer
+static const char *const malformed[] = {
+    "{\"type\":\"get\",\"quantity\":}",
+    "{\"type\"}",
+    "{\"type\":\"get\",}",
+    "[{\"type\":\"get\"},]",
+    "{\"type\":\"get\",\"quantity\":[\"temperature\" \"pressure\"]}",
+    "{\"type\":\"get\"",
+    "{type:\"get\"}",
+    "{\"type\":\"get\"}}",
+    "{\"type\":\"get\" \"id\":7}",
+    "{\"type\":\"get\",\"id\":7]"};
+
+static const char *const keys[] = {"type", "quantity", "name", "value"};
+#define NUM_KEYS (sizeof(keys) / sizeof(keys[0]))
+
+// PRIVATE FUNCTIONS
+
+/** Replay a corpus
+
+**Parameters**
+    - *corpus : array of messages
+    - num_messages : number of messages
+    - extract : also look up the fields of every command
+    - *bytes : output for the bytes of one replay
+    - *mismatches : output for the number of messages that
+        were not parsed as expected
+
+**Return**
+    Time of all replays in microseconds.
+
+**Description**
+    Valid messages must give tokens and malformed ones an
+    error. The tokens live on the stack like the arena of
+    the weather station.
+*/
+static int64_t replay_corpus(const char *const *corpus,
+                             int num_messages,
+                             bool extract,
+                             int *bytes,
+                             int *mismatches) {
+    pl_json_token_t tokens[MAX_TOKENS];
+    char text[MAX_LENGTH];
+    int values[NUM_KEYS];
+    pl_json_t doc;
+    int num_tokens;
+    int64_t start;
+
+    *bytes = 0;
+    *mismatches = 0;
+    for (int m = 0; m < num_messages; m++) {
+        *bytes += strlen(corpus[m]);
+    }
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int m = 0; m < num_messages; m++) {
+            // the weather station parses its receive buffer
+            strcpy(text, corpus[m]);
+            num_tokens = pl_json_parse(&doc, text, strlen(text), tokens, MAX_TOKENS);
+            if ((num_tokens > 0) != (corpus == valid)) {
+                (*mismatches)++;
+            }
+            if (extract && num_tokens > 0) {
+                // a batch is an array of commands
+                for (int c = pl_json_is(&doc, 0, PL_JSON_ARRAY) ? 1 : 0;
+                     c < num_tokens;
+                     c = pl_json_next(&doc, c)) {
+                    pl_json_extract(&doc, c, keys, values, NUM_KEYS);
+                }
+            }
+        }
+    }
+    return esp_timer_get_time() - start;
+}
+
+/** Print one result as a JSON line
+
+**Parameters**
+    - *api : `parse` for the tokenizer alone, `extract`
+        with the lookup of the fields
+    - *corpus : name of the corpus
+    - num_messages : messages per replay
+    - bytes : bytes per replay
+    - time_us : time of all replays in microseconds
+    - mismatches : messages not parsed as expected
+    - heap_delta : change of the free heap in bytes
+*/
+static void print_json_result(const char *api,
+                              const char *corpus,
+                              int num_messages,
+                              int bytes,
+                              int64_t time_us,
+                              int mismatches,
+                              int heap_delta) {
+    // below the resolution of the timer
+    double us = (double)((time_us > 0) ? time_us : 1);
+
+    printf("{\"type\":\"benchmark\",\"op\":\"json\",\"api\":\"%s\",\"corpus\":\"%s\","
+           "\"messages\":%d,\"iterations\":%d,\"us_per_message\":%.3f,"
+           "\"mb_per_s\":%.3f,\"mismatches\":%d,\"heap_delta\":%d}\n",
+           api, corpus, num_messages, ITERATIONS,
+           us / ITERATIONS / num_messages,
+           (double)bytes * ITERATIONS / us,
+           mismatches / ITERATIONS, heap_delta);
+}
+
+// TEST CASES
+
+/** Benchmark the tokenizer
+
+**Description**
+    Replay a corpus of valid and malformed commands, once
+    only tokenized and once with the lookup of the fields
+    of every command. Print one JSON line per measurement
+    with the time per message, the throughput, the messages
+    not accepted or rejected as expected and the change of
+    the free heap.
+*/
+TEST_CASE("JSON benchmark", "[pl_json][benchmark]") {
+    const struct {
+        const char *name;
+        const char *const *messages;
+        int num_messages;
+    } corpora[] = {
+        {"valid", valid, sizeof(valid) / sizeof(valid[0])},
+        {"malformed", malformed, sizeof(malformed) / sizeof(malformed[0])}};
+    int64_t time_us;
+    uint32_t heap;
+    int bytes;
+    int mismatches;
+
+    for (int c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        for (int extract = 0; extract <= 1; extract++) {
+            heap = esp_get_free_heap_size();
+            time_us = replay_corpus(corpora[c].messages,
+                                    corpora[c].num_messages,
+                                    extract,
+                                    &bytes,
+                                    &mismatches);
+            print_json_result(extract ? "extract" : "parse",
+                              corpora[c].name,
+                              corpora[c].num_messages,
+                              bytes,
+                              time_us,
+                              mismatches,
+                              (int)heap - (int)esp_get_free_heap_size());
+        }
+    }
+}
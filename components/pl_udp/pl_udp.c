@@ -1,25 +1,32 @@
 // PROTOCOL LAYER
 // Source file of the UDP component.
 
+// compile time log level of this hot path, see general.h
+#define LOG_COMPONENT_LEVEL CONFIG_LOG_LEVEL_PL_UDP
+
 // components
 #include "./pl_udp.h"
 
 #include "../al_crypto/al_crypto.h"
 #include "../general/general.h"
+#include "../logger/logger.h"
+#include "../metrics/metrics.h"
+#include "../registry/registry.h"
+
+// c
+#include <string.h>
 
 // esp-idf
 #include "esp_log.h"
 #include "esp_netif.h"
-#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "lwip/def.h"
 #include "lwip/err.h"
 #include "lwip/inet.h"
 #include "lwip/sockets.h"
 
-// length of the receiving buffer in bytes
-#define BUFFER_LENGTH 257
-
 ESP_EVENT_DEFINE_BASE(UDP_EVENT);
 
 // Socket file descriptor which will be the output of
@@ -27,7 +34,8 @@ ESP_EVENT_DEFINE_BASE(UDP_EVENT);
 int sock = -1;
 
 // Socket structure for receiving and sending, see
-// `lwip/sockets.h`
+// `lwip/sockets.h`. `rx_addr` is only the address to bind,
+// the sender of a frame is received into a local one.
 struct sockaddr_in rx_addr;
 struct sockaddr_in tx_addr;
 // Length of receiving socket structure from
@@ -35,18 +43,1177 @@ struct sockaddr_in tx_addr;
 socklen_t rx_addr_len;
 socklen_t tx_addr_len;
 
-// String buffer for incoming messages (256 characters).
-char rx_buffer[BUFFER_LENGTH];
+// Buffer for incoming frames, decrypted in place. One byte
+// more for the terminating null of the message.
+byte_t rx_buffer[AL_CRYPTO_FRAME_LENGTH + 1];
 
 // Buffer for ip address.
 char ip_addr[128];
 
+// time and key id of the last frame that arrived, only
+// used by the receive task
+int64_t rx_time = 0;
+uint8_t rx_key = AL_CRYPTO_ACTIVE_KEY;
+
 // Tag for logging from this component.
 static const char *TAG = "pl_udp";
 
 // Flag checked by send and receive to see if udp is ready
 // to use.
 bool udp_ready = false;
+// task that receives the frames, created on the first IP
+// address
+TaskHandle_t receive_task = NULL;
+
+// number of senders whose sequence numbers are tracked
+#define MAX_PEERS 8
+// number of sequence numbers below the highest one that
+// are still accepted once
+#define REPLAY_WINDOW 64
+
+// replay window of one sender
+typedef struct peer_t {
+    uint32_t sender;
+    // highest accepted sequence number
+    uint64_t highest;
+    // bit i is set if `highest - i` was accepted
+    uint64_t bitmap;
+    // tick of the last accepted frame
+    TickType_t last_seen;
+    bool used;
+} peer_t;
+
+// replay windows, only used by the receive task
+peer_t peers[MAX_PEERS];
+
+// first byte of a fragment, a complete message starts with
+// `{` or `[`
+#define FRAGMENT_MARKER 0x01
+// [marker][message id, 2 bytes][index + 1][count], no byte
+// is ever zero so CBC padding can still be stripped
+#define FRAGMENT_HEADER_LENGTH 5
+// message bytes in every fragment but the last
+#define FRAGMENT_DATA_LENGTH (AL_CRYPTO_MESSAGE_LENGTH - FRAGMENT_HEADER_LENGTH)
+// maximum number of fragments of a message, at most 32
+#define MAX_FRAGMENTS \
+    ((CONFIG_UDP_MAX_MESSAGE_LENGTH + FRAGMENT_DATA_LENGTH - 1) / FRAGMENT_DATA_LENGTH)
+
+// fragmented message that is being received
+typedef struct reassembly_t {
+    // source address and port and id of the message
+    uint32_t addr;
+    uint16_t port;
+    uint16_t id;
+    int count;
+    // bit i is set if fragment i arrived
+    uint32_t received;
+    // length of the message, known with the last fragment
+    int length;
+    // tick of the first fragment
+    TickType_t started;
+    bool used;
+    char message[CONFIG_UDP_MAX_MESSAGE_LENGTH];
+} reassembly_t;
+
+// reassembly buffers, only used by the receive task
+reassembly_t reassemblies[CONFIG_UDP_REASSEMBLY_BUFFERS];
+
+// id of the last fragmented message that was sent
+uint16_t message_id = 0;
+portMUX_TYPE message_id_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// first byte of a reliable message
+#define RELIABLE_MARKER 0x02
+// [marker][sequence number, 2 bytes][ack, 2 bytes], the
+// numbers have 14 bits and the top bit of every byte is
+// set
+#define RELIABLE_HEADER_LENGTH 5
+// sequence numbers run from 1 to `RELIABLE_SEQ_MAX`, 0
+// means none
+#define RELIABLE_SEQ_MAX 0x3fff
+// retransmission timeout in microseconds before the first
+// round trip was measured and its bounds
+#define RTO_INITIAL 1000000
+#define RTO_MIN 200000
+#define RTO_MAX 8000000
+// number of clients whose recent sequence numbers are kept
+#define MAX_CLIENTS 4
+// recent sequence numbers per client to detect duplicates
+#define CLIENT_HISTORY 16
+// number of received reliable messages waiting for an ack
+#define MAX_PENDING_ACKS 8
+
+// client that sends reliable messages
+typedef struct client_t {
+    uint32_t addr;
+    uint16_t port;
+    // ring of the last received sequence numbers
+    uint16_t seqs[CLIENT_HISTORY];
+    int next;
+    int64_t last_seen;
+    bool used;
+} client_t;
+
+// reliable message that was received but not acked yet
+typedef struct pending_ack_t {
+    uint32_t addr;
+    uint16_t port;
+    uint16_t seq;
+    uint8_t key_id;
+    // time to send a plain ack if no reply carried it
+    int64_t deadline;
+    bool used;
+} pending_ack_t;
+
+// reliable message that was sent but not acked yet
+typedef struct outgoing_t {
+    struct sockaddr_in to;
+    uint16_t seq;
+    // key of the request
+    uint8_t key_id;
+    // time of the first transmission
+    int64_t sent;
+    // time of the next retransmission
+    int64_t deadline;
+    int64_t rto;
+    int retries;
+    bool used;
+    // the message with its header
+    int length;
+    char message[CONFIG_UDP_MAX_MESSAGE_LENGTH + 1];
+} outgoing_t;
+
+// state of the reliable messages, used by the receive task,
+// the senders of replies and the retransmission timer
+SemaphoreHandle_t reliable_lock = NULL;
+esp_timer_handle_t reliable_timer = NULL;
+client_t clients[MAX_CLIENTS];
+pending_ack_t pending_acks[MAX_PENDING_ACKS];
+outgoing_t outgoing[CONFIG_UDP_RELIABLE_WINDOW];
+// sequence number of the last reliable message that was sent
+uint16_t reliable_seq = 0;
+// smoothed round trip time and its mean deviation in
+// microseconds, 0 before the first measurement
+int64_t srtt = 0;
+int64_t rttvar = 0;
+int64_t rto = RTO_INITIAL;
+
+// number of sources whose token buckets are kept
+#define MAX_SOURCES 8
+// tokens are counted in thousandths of a frame
+#define TOKEN 1000
+
+// token bucket of one source address
+typedef struct source_t {
+    uint32_t addr;
+    int64_t tokens;
+    // time of the last refill
+    int64_t refilled;
+    bool used;
+} source_t;
+
+// token buckets, only used by the receive task
+source_t sources[MAX_SOURCES];
+
+// number of posted messages the application did not finish
+int in_flight = 0;
+portMUX_TYPE in_flight_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// buffer to post a received message, only used by the
+// receive task
+uint32_t post_buffer[(sizeof(pl_udp_message_t) + CONFIG_UDP_MAX_MESSAGE_LENGTH + 1 + 3) / 4];
+
+// counters of the dropped frames
+uint32_t num_replayed = 0;
+uint32_t num_forged = 0;
+uint32_t num_fragments_dropped = 0;
+// number of reliable messages that were given up
+uint32_t num_unacked = 0;
+// frames of an impossible length
+uint32_t num_bad_length = 0;
+// frames above the rate of their source
+uint32_t num_rate_limited = 0;
+// messages answered with busy
+uint32_t num_busy = 0;
+
+// longest stamp `,"uptime":<10 digits>,"seq":<10 digits>}`
+// with its null
+#define STAMP_LENGTH 40
+
+// sequence number of the last stamped broadcast and the
+// time it was sent. replies to a single client have their
+// own sequence numbers, the collector does not see them.
+uint32_t tx_seq = 0;
+uint32_t reply_seq = 0;
+int64_t last_sent = 0;
+portMUX_TYPE stamp_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// PRIVATE FUNCTIONS
+
+/** Find the replay window of a sender.
+
+**Parameters**
+    - sender : id of the sender
+
+**Return**
+    The window or NULL if the sender is not tracked.
+*/
+peer_t *find_peer(uint32_t sender) {
+    for (int i = 0; i < MAX_PEERS; i++) {
+        if (peers[i].used && peers[i].sender == sender) {
+            return &peers[i];
+        }
+    }
+    return NULL;
+}
+
+/** Check if a sequence number was seen before.
+
+**Parameters**
+    - sender : id of the sender
+    - sequence : sequence number of the frame
+
+**Return**
+    True if the frame is a duplicate or older than the
+    window and must be dropped.
+
+**Description**
+    Constant time check against the bitmap. A sender that is
+    not tracked yet is accepted.
+*/
+bool replay_seen(uint32_t sender, uint64_t sequence) {
+    peer_t *peer = find_peer(sender);
+    uint64_t age;
+
+    if (peer == NULL || sequence > peer->highest) {
+        return false;
+    }
+    age = peer->highest - sequence;
+    return age >= REPLAY_WINDOW || (peer->bitmap & ((uint64_t)1 << age));
+}
+
+/** Mark a sequence number as accepted.
+
+**Parameters**
+    - sender : id of the sender
+    - sequence : sequence number of the authenticated frame
+
+**Description**
+    Slide the window forward for a new highest sequence
+    number or set its bit. A new sender takes a free slot
+    or the one of the sender that was quiet the longest.
+*/
+void replay_accept(uint32_t sender, uint64_t sequence) {
+    peer_t *peer = find_peer(sender);
+    uint64_t shift;
+
+    if (peer == NULL) {
+        peer = &peers[0];
+        for (int i = 0; i < MAX_PEERS; i++) {
+            if (!peers[i].used) {
+                peer = &peers[i];
+                break;
+            }
+            if (peers[i].last_seen < peer->last_seen) {
+                peer = &peers[i];
+            }
+        }
+        if (peer->used) {
+            ESP_LOGI(TAG, "replay window of sender %08x evicted", peer->sender);
+        }
+        peer->sender = sender;
+        peer->highest = sequence;
+        peer->bitmap = 1;
+        peer->used = true;
+    } else if (sequence > peer->highest) {
+        shift = sequence - peer->highest;
+        peer->bitmap = (shift >= REPLAY_WINDOW) ? 0 : peer->bitmap << shift;
+        peer->bitmap |= 1;
+        peer->highest = sequence;
+    } else {
+        peer->bitmap |= (uint64_t)1 << (peer->highest - sequence);
+    }
+    peer->last_seen = xTaskGetTickCount();
+}
+
+/** Get the id of a new fragmented message.
+
+**Return**
+    Message id without a zero byte.
+
+**Description**
+    Safe to call from any task.
+*/
+uint16_t new_message_id() {
+    uint16_t id;
+
+    portENTER_CRITICAL(&message_id_lock);
+    do {
+        id = ++message_id;
+    } while ((id & 0xff) == 0 || (id >> 8) == 0);
+    portEXIT_CRITICAL(&message_id_lock);
+    return id;
+}
+
+/** Encrypt a frame and send it.
+
+**Parameters**
+    - *frame : buffer of `AL_CRYPTO_FRAME_LENGTH` bytes with
+        the message behind the header
+    - length : length of the message
+    - key_id : key to encrypt with
+    - *to : destination address
+*/
+void send_frame(byte_t *frame, int length, uint8_t key_id, const struct sockaddr_in *to) {
+    int64_t start = esp_timer_get_time();
+    const uint8_t *ip;
+    int frame_len;
+    int err;
+
+    if (al_crypto_encrypt(frame, length, key_id, &frame_len) != ESP_OK) {
+        return;
+    }
+    metrics_record(METRICS_ENCRYPT, esp_timer_get_time() - start);
+
+    // check if socket was created
+    if (sock >= 0 && udp_ready == true) {
+        // send message via socket
+        start = esp_timer_get_time();
+        err = sendto(sock,
+                     frame,
+                     frame_len,
+                     0,
+                     (struct sockaddr *)to,
+                     sizeof(*to));
+        metrics_record(METRICS_SEND, esp_timer_get_time() - start);
+
+        if (err < 0) {
+            ESP_LOGE(TAG,
+                     "unable to send message error %d",
+                     err);
+        } else {
+            // bytes of the address in network order
+            ip = (const uint8_t *)&to->sin_addr.s_addr;
+            LOGGER_D(TAG,
+                     "<< %u.%u.%u.%u:%u (%d bytes)",
+                     ip[0], ip[1], ip[2], ip[3],
+                     ntohs(to->sin_port),
+                     frame_len);
+        }
+    }
+}
+
+/** Copy a range of a message that is split in two parts.
+
+**Parameters**
+    - *dest : destination buffer
+    - offset : start of the range in the message
+    - length : length of the range
+    - *msg : first part of the message
+    - msg_len : length of the first part
+    - *tail : second part of the message
+*/
+void copy_message(byte_t *dest,
+                  int offset,
+                  int length,
+                  const char *msg,
+                  int msg_len,
+                  const char *tail) {
+    int n;
+
+    if (offset < msg_len) {
+        n = (length < msg_len - offset) ? length : msg_len - offset;
+        memcpy(dest, msg + offset, n);
+        dest += n;
+        offset += n;
+        length -= n;
+    }
+    if (length > 0) {
+        memcpy(dest, tail + offset - msg_len, length);
+    }
+}
+
+/** Send a message in one frame or in fragments.
+
+**Parameters**
+    - *msg : the message
+    - msg_len : length of the message
+    - *tail : appended to the message, may be NULL
+    - tail_len : length of the tail
+    - key_id : key to encrypt with
+    - *to : destination address
+
+**Requirements**
+    Message and tail are at most
+    `CONFIG_UDP_MAX_MESSAGE_LENGTH` bytes together.
+*/
+void send_message(const char *msg,
+                  int msg_len,
+                  const char *tail,
+                  int tail_len,
+                  uint8_t key_id,
+                  const struct sockaddr_in *to) {
+    // frame on the stack of the calling task, so sending is
+    // safe from any task
+    byte_t frame[AL_CRYPTO_FRAME_LENGTH];
+    byte_t *fragment = frame + AL_CRYPTO_HEADER_LENGTH;
+    int length = msg_len + tail_len;
+    uint16_t id;
+    int count;
+    int data_len;
+
+    // a short message is sent as it is
+    if (length <= AL_CRYPTO_MESSAGE_LENGTH) {
+        // place the message behind the header and encrypt
+        // it there
+        copy_message(fragment, 0, length, msg, msg_len, tail);
+        send_frame(frame, length, key_id, to);
+        return;
+    }
+
+    id = new_message_id();
+    count = (length + FRAGMENT_DATA_LENGTH - 1) / FRAGMENT_DATA_LENGTH;
+    ESP_LOGD(TAG, "sending message %u in %d fragments", id, count);
+
+    for (int i = 0; i < count; i++) {
+        data_len = length - i * FRAGMENT_DATA_LENGTH;
+        if (data_len > FRAGMENT_DATA_LENGTH) {
+            data_len = FRAGMENT_DATA_LENGTH;
+        }
+        fragment[0] = FRAGMENT_MARKER;
+        fragment[1] = id >> 8;
+        fragment[2] = id & 0xff;
+        fragment[3] = i + 1;
+        fragment[4] = count;
+        copy_message(fragment + FRAGMENT_HEADER_LENGTH,
+                     i * FRAGMENT_DATA_LENGTH,
+                     data_len,
+                     msg,
+                     msg_len,
+                     tail);
+        send_frame(frame, FRAGMENT_HEADER_LENGTH + data_len, key_id, to);
+    }
+}
+
+/** Stamp an outbound message with the uptime and a
+    sequence number.
+
+**Parameters**
+    - *msg : the message
+    - *msg_len : length of the message, shortened by the
+        closing brace that the stamp replaces
+    - *stamp : buffer of `STAMP_LENGTH` bytes for the stamp
+    - broadcast : `true` for a broadcast, `false` for a
+        reply to a single client
+
+**Return**
+    Length of the stamp, 0 if the message is no JSON object
+    and is sent as it is.
+
+**Description**
+    The stamp `,"uptime":<s>,"seq":<n>}` is appended in
+    place of the closing brace. The collector sees that the
+    station is alive from any broadcast, a reboot from the
+    uptime and lost messages from gaps in the sequence
+    numbers. Only a broadcast takes the next of these
+    numbers and records the time for `pl_udp_last_sent`,
+    replies count separately.
+*/
+int stamp_message(const char *msg, int *msg_len, char *stamp, bool broadcast) {
+    int64_t now = esp_timer_get_time();
+    uint32_t seq;
+
+    if (*msg_len < 2 || msg[0] != '{' || msg[*msg_len - 1] != '}') {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&stamp_lock);
+    if (broadcast) {
+        seq = ++tx_seq;
+        last_sent = now;
+    } else {
+        seq = ++reply_seq;
+    }
+    portEXIT_CRITICAL(&stamp_lock);
+
+    (*msg_len)--;
+    return sprintf(stamp,
+                   "%s\"uptime\":%u,\"seq\":%u}",
+                   (*msg_len > 1) ? "," : "",
+                   (uint32_t)(now / 1000000),
+                   seq);
+}
+
+/** Stamp a message and broadcast it.
+
+**Parameters**
+    - *msg : the message
+    - key_id : key to encrypt with
+*/
+void broadcast(const char *msg, uint8_t key_id) {
+    int msg_len = strlen(msg);
+    char stamp[STAMP_LENGTH];
+    int stamp_len;
+
+    // check if the message can be sent
+    if (msg_len + STAMP_LENGTH > CONFIG_UDP_MAX_MESSAGE_LENGTH) {
+        ESP_LOGW(TAG,
+                 "cannot send a message of length %d bytes, maximum is %d bytes. Aborting sending!",
+                 msg_len,
+                 CONFIG_UDP_MAX_MESSAGE_LENGTH - STAMP_LENGTH);
+        return;
+    } else {
+        ESP_LOGV(TAG, "plain message: %s", msg);
+    }
+
+    stamp_len = stamp_message(msg, &msg_len, stamp, true);
+    send_message(msg, msg_len, stamp, stamp_len, key_id, &tx_addr);
+}
+
+/** Discard the incomplete messages that timed out.
+
+**Parameters**
+    - now : current tick
+*/
+void expire_reassemblies(TickType_t now) {
+    reassembly_t *slot;
+
+    for (int i = 0; i < CONFIG_UDP_REASSEMBLY_BUFFERS; i++) {
+        slot = &reassemblies[i];
+        if (slot->used &&
+            now - slot->started > pdMS_TO_TICKS(CONFIG_UDP_REASSEMBLY_TIMEOUT)) {
+            ESP_LOGD(TAG, "message %u timed out with %d of %d fragments",
+                     slot->id, __builtin_popcount(slot->received), slot->count);
+            num_fragments_dropped += __builtin_popcount(slot->received);
+            slot->used = false;
+        }
+    }
+}
+
+/** Find or start the reassembly of a message.
+
+**Parameters**
+    - addr : source address
+    - port : source port
+    - id : message id
+    - count : number of fragments
+    - now : current tick
+
+**Return**
+    The reassembly or NULL if all buffers are in use.
+*/
+reassembly_t *find_reassembly(uint32_t addr,
+                              uint16_t port,
+                              uint16_t id,
+                              int count,
+                              TickType_t now) {
+    reassembly_t *free_slot = NULL;
+
+    for (int i = 0; i < CONFIG_UDP_REASSEMBLY_BUFFERS; i++) {
+        if (!reassemblies[i].used) {
+            if (free_slot == NULL) {
+                free_slot = &reassemblies[i];
+            }
+        } else if (reassemblies[i].addr == addr &&
+                   reassemblies[i].port == port &&
+                   reassemblies[i].id == id) {
+            return &reassemblies[i];
+        }
+    }
+
+    if (free_slot != NULL) {
+        free_slot->addr = addr;
+        free_slot->port = port;
+        free_slot->id = id;
+        free_slot->count = count;
+        free_slot->received = 0;
+        free_slot->length = 0;
+        free_slot->started = now;
+        free_slot->used = true;
+    }
+    return free_slot;
+}
+
+/** Take a token from the bucket of a source.
+
+**Parameters**
+    - addr : source address
+
+**Return**
+    False if the source exceeds its rate.
+
+**Description**
+    The bucket fills with `CONFIG_UDP_RATE_LIMIT` frames per
+    second up to `CONFIG_UDP_RATE_BURST` frames. A new source
+    starts with a full bucket in a free slot or in the one
+    of the source that was quiet the longest.
+*/
+bool rate_admit(uint32_t addr) {
+    int64_t now = esp_timer_get_time();
+    source_t *source = NULL;
+    source_t *victim = &sources[0];
+
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        if (sources[i].used && sources[i].addr == addr) {
+            source = &sources[i];
+            break;
+        }
+        if (victim->used && (!sources[i].used || sources[i].refilled < victim->refilled)) {
+            victim = &sources[i];
+        }
+    }
+
+    if (source == NULL) {
+        source = victim;
+        source->addr = addr;
+        source->tokens = CONFIG_UDP_RATE_BURST * TOKEN;
+        source->used = true;
+    } else {
+        source->tokens += (now - source->refilled) * CONFIG_UDP_RATE_LIMIT * TOKEN / 1000000;
+        if (source->tokens > CONFIG_UDP_RATE_BURST * TOKEN) {
+            source->tokens = CONFIG_UDP_RATE_BURST * TOKEN;
+        }
+    }
+    source->refilled = now;
+
+    if (source->tokens < TOKEN) {
+        return false;
+    }
+    source->tokens -= TOKEN;
+    return true;
+}
+
+/** Post a received message to the event loop.
+
+**Parameters**
+    - *text : the message
+    - length : length of the message
+    - *from : source of the message
+    - seq : sequence number of a reliable message or 0
+
+**Description**
+    If `CONFIG_UDP_MAX_IN_FLIGHT` messages wait for the
+    application or the event queue is full, answer busy
+    instead of waiting.
+*/
+void post_message(const char *text, int length, const struct sockaddr_in *from, uint16_t seq) {
+    pl_udp_message_t *message = (pl_udp_message_t *)post_buffer;
+    bool admitted;
+
+    message->addr = from->sin_addr.s_addr;
+    message->port = from->sin_port;
+    message->seq = seq;
+    message->key_id = rx_key;
+    message->received = rx_time;
+    memcpy(message->text, text, length);
+    message->text[length] = '\0';
+    ESP_LOGV(TAG, "message: '%s'", message->text);
+
+    portENTER_CRITICAL(&in_flight_lock);
+    admitted = (in_flight < CONFIG_UDP_MAX_IN_FLIGHT);
+    if (admitted) {
+        in_flight++;
+    }
+    portEXIT_CRITICAL(&in_flight_lock);
+
+    // post the message with its terminating null
+    if (admitted &&
+        esp_event_post(UDP_EVENT,
+                       UDP_EVENT_RECEIVED,
+                       message,
+                       sizeof(pl_udp_message_t) + length + 1,
+                       0) != ESP_OK) {
+        pl_udp_done();
+        admitted = false;
+    }
+
+    if (!admitted) {
+        ESP_LOGD(TAG, "busy, %d messages in flight", in_flight);
+        num_busy++;
+        pl_udp_reply(message, "{\"type\":\"error\",\"error\":\"busy\"}");
+    }
+}
+
+/** Write a sequence number of a reliable header. */
+void write_seq(char *bytes, uint16_t seq) {
+    bytes[0] = 0x80 | (seq >> 7);
+    bytes[1] = 0x80 | (seq & 0x7f);
+}
+
+/** Read a sequence number of a reliable header.
+
+**Return**
+    False if the top bit of a byte is not set.
+*/
+bool read_seq(const char *bytes, uint16_t *seq) {
+    if (!(bytes[0] & 0x80) || !(bytes[1] & 0x80)) {
+        return false;
+    }
+    *seq = ((bytes[0] & 0x7f) << 7) | (bytes[1] & 0x7f);
+    return true;
+}
+
+/** Fill a socket address from an address and a port. */
+void make_addr(struct sockaddr_in *to, uint32_t addr, uint16_t port) {
+    memset(to, 0, sizeof(*to));
+    to->sin_family = AF_INET;
+    to->sin_addr.s_addr = addr;
+    to->sin_port = port;
+}
+
+/** Send a plain ack.
+
+**Parameters**
+    - addr : address of the client
+    - port : port of the client
+    - seq : sequence number to ack
+    - key_id : key of the acked message
+*/
+void send_ack(uint32_t addr, uint16_t port, uint16_t seq, uint8_t key_id) {
+    char header[RELIABLE_HEADER_LENGTH];
+    struct sockaddr_in to;
+
+    header[0] = RELIABLE_MARKER;
+    write_seq(header + 1, 0);
+    write_seq(header + 3, seq);
+    make_addr(&to, addr, port);
+    ESP_LOGD(TAG, "ack %u", seq);
+    send_message(header, RELIABLE_HEADER_LENGTH, NULL, 0, key_id, &to);
+}
+
+/** Check a sequence number for a duplicate and record it.
+
+**Parameters**
+    - addr : address of the client
+    - port : port of the client
+    - seq : sequence number of the message
+
+**Return**
+    True if the client sent the number recently.
+
+**Description**
+    A new client takes a free slot or the one of the client
+    that was quiet the longest. Requires `reliable_lock`.
+*/
+bool client_duplicate(uint32_t addr, uint16_t port, uint16_t seq) {
+    client_t *client = NULL;
+    client_t *victim = &clients[0];
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].used && clients[i].addr == addr && clients[i].port == port) {
+            client = &clients[i];
+            break;
+        }
+        if (victim->used && (!clients[i].used || clients[i].last_seen < victim->last_seen)) {
+            victim = &clients[i];
+        }
+    }
+
+    if (client == NULL) {
+        client = victim;
+        memset(client, 0, sizeof(client_t));
+        client->addr = addr;
+        client->port = port;
+        client->used = true;
+    }
+    client->last_seen = esp_timer_get_time();
+
+    for (int i = 0; i < CLIENT_HISTORY; i++) {
+        if (client->seqs[i] == seq) {
+            return true;
+        }
+    }
+    client->seqs[client->next] = seq;
+    client->next = (client->next + 1) % CLIENT_HISTORY;
+    return false;
+}
+
+/** Start the timer for the earliest pending ack or
+    retransmission.
+
+**Description**
+    Requires `reliable_lock`.
+*/
+void arm_reliable_timer() {
+    int64_t deadline = INT64_MAX;
+    int64_t now;
+
+    for (int i = 0; i < MAX_PENDING_ACKS; i++) {
+        if (pending_acks[i].used && pending_acks[i].deadline < deadline) {
+            deadline = pending_acks[i].deadline;
+        }
+    }
+    for (int i = 0; i < CONFIG_UDP_RELIABLE_WINDOW; i++) {
+        if (outgoing[i].used && outgoing[i].deadline < deadline) {
+            deadline = outgoing[i].deadline;
+        }
+    }
+
+    esp_timer_stop(reliable_timer);
+    if (deadline != INT64_MAX) {
+        now = esp_timer_get_time();
+        esp_timer_start_once(reliable_timer, (deadline > now) ? deadline - now : 1);
+    }
+}
+
+/** Remember to ack a received reliable message.
+
+**Description**
+    The ack is sent with the reply to the message or alone
+    after `CONFIG_UDP_ACK_DELAY`. If too many acks are
+    pending it is sent at once. Requires `reliable_lock`.
+*/
+void queue_ack(uint32_t addr, uint16_t port, uint16_t seq, uint8_t key_id) {
+    for (int i = 0; i < MAX_PENDING_ACKS; i++) {
+        if (!pending_acks[i].used) {
+            pending_acks[i].addr = addr;
+            pending_acks[i].port = port;
+            pending_acks[i].seq = seq;
+            pending_acks[i].key_id = key_id;
+            pending_acks[i].deadline = esp_timer_get_time() + CONFIG_UDP_ACK_DELAY * 1000;
+            pending_acks[i].used = true;
+            arm_reliable_timer();
+            return;
+        }
+    }
+    send_ack(addr, port, seq, key_id);
+}
+
+/** Forget a pending ack that is sent with a reply.
+
+**Description**
+    Requires `reliable_lock`.
+*/
+void take_ack(uint32_t addr, uint16_t port, uint16_t seq) {
+    for (int i = 0; i < MAX_PENDING_ACKS; i++) {
+        if (pending_acks[i].used && pending_acks[i].addr == addr &&
+            pending_acks[i].port == port && pending_acks[i].seq == seq) {
+            pending_acks[i].used = false;
+        }
+    }
+}
+
+/** Update the retransmission timeout with a round trip.
+
+**Parameters**
+    - sample : measured round trip time in microseconds
+
+**Description**
+    Smoothed round trip time and mean deviation as in RFC
+    6298, the timeout is their sum with four times the
+    deviation. Requires `reliable_lock`.
+*/
+void update_rto(int64_t sample) {
+    int64_t delta;
+
+    if (srtt == 0) {
+        srtt = sample;
+        rttvar = sample / 2;
+    } else {
+        delta = (srtt > sample) ? srtt - sample : sample - srtt;
+        rttvar = (3 * rttvar + delta) / 4;
+        srtt = (7 * srtt + sample) / 8;
+    }
+
+    rto = srtt + 4 * rttvar;
+    if (rto < RTO_MIN) {
+        rto = RTO_MIN;
+    } else if (rto > RTO_MAX) {
+        rto = RTO_MAX;
+    }
+    ESP_LOGD(TAG, "rtt %lld us, rto %lld us", sample, rto);
+}
+
+/** Handle an ack of a client.
+
+**Parameters**
+    - *from : source of the ack
+    - ack : acked sequence number
+
+**Description**
+    Remove the message from the window. Only a message that
+    was not retransmitted gives a round trip sample.
+    Requires `reliable_lock`.
+*/
+void handle_ack(const struct sockaddr_in *from, uint16_t ack) {
+    outgoing_t *slot;
+
+    for (int i = 0; i < CONFIG_UDP_RELIABLE_WINDOW; i++) {
+        slot = &outgoing[i];
+        if (slot->used && slot->seq == ack &&
+            slot->to.sin_addr.s_addr == from->sin_addr.s_addr &&
+            slot->to.sin_port == from->sin_port) {
+            if (slot->retries == 0) {
+                update_rto(esp_timer_get_time() - slot->sent);
+            }
+            slot->used = false;
+            arm_reliable_timer();
+            return;
+        }
+    }
+}
+
+/** Send the due acks and retransmissions.
+
+**Parameters**
+    - *arg : unused
+
+**Description**
+    Callback of the one shot `reliable_timer`. A message is
+    retransmitted with a doubled timeout and given up after
+    `CONFIG_UDP_RELIABLE_RETRIES` retransmissions.
+*/
+void reliable_timeout(void *arg) {
+    int64_t now = esp_timer_get_time();
+    outgoing_t *slot;
+
+    xSemaphoreTake(reliable_lock, portMAX_DELAY);
+
+    for (int i = 0; i < MAX_PENDING_ACKS; i++) {
+        if (pending_acks[i].used && pending_acks[i].deadline <= now) {
+            pending_acks[i].used = false;
+            send_ack(pending_acks[i].addr, pending_acks[i].port, pending_acks[i].seq, pending_acks[i].key_id);
+        }
+    }
+
+    for (int i = 0; i < CONFIG_UDP_RELIABLE_WINDOW; i++) {
+        slot = &outgoing[i];
+        if (!slot->used || slot->deadline > now) {
+            continue;
+        }
+        if (slot->retries >= CONFIG_UDP_RELIABLE_RETRIES) {
+            ESP_LOGW(TAG, "message %u was not acked", slot->seq);
+            num_unacked++;
+            slot->used = false;
+            continue;
+        }
+        slot->retries++;
+        slot->rto = (2 * slot->rto < RTO_MAX) ? 2 * slot->rto : RTO_MAX;
+        slot->deadline = now + slot->rto;
+        ESP_LOGD(TAG, "retransmitting message %u, try %d", slot->seq, slot->retries);
+        send_message(slot->message, slot->length, NULL, 0, slot->key_id, &slot->to);
+    }
+
+    arm_reliable_timer();
+    xSemaphoreGive(reliable_lock);
+}
+
+/** Deliver a complete message.
+
+**Parameters**
+    - *text : the message
+    - length : length of the message
+    - *from : source of the message
+
+**Description**
+    Strip the header of a reliable message. Handle its ack,
+    drop it if it is a duplicate and queue its ack. Post
+    everything but plain acks.
+*/
+void deliver(const char *text, int length, const struct sockaddr_in *from) {
+    uint16_t seq = 0;
+    uint16_t ack = 0;
+    bool duplicate = false;
+
+    if (length > 0 && text[0] == RELIABLE_MARKER) {
+        if (length < RELIABLE_HEADER_LENGTH ||
+            !read_seq(text + 1, &seq) || !read_seq(text + 3, &ack)) {
+            ESP_LOGD(TAG, "malformed reliable header");
+            return;
+        }
+        text += RELIABLE_HEADER_LENGTH;
+        length -= RELIABLE_HEADER_LENGTH;
+
+        xSemaphoreTake(reliable_lock, portMAX_DELAY);
+        if (ack != 0) {
+            handle_ack(from, ack);
+        }
+        if (seq != 0) {
+            duplicate = client_duplicate(from->sin_addr.s_addr, from->sin_port, seq);
+            if (duplicate) {
+                // the ack got lost, send it again
+                send_ack(from->sin_addr.s_addr, from->sin_port, seq, rx_key);
+            } else {
+                queue_ack(from->sin_addr.s_addr, from->sin_port, seq, rx_key);
+            }
+        }
+        xSemaphoreGive(reliable_lock);
+
+        if (duplicate || length == 0) {
+            return;
+        }
+    }
+
+    post_message(text, length, from, seq);
+}
+
+/** Add a fragment to its message.
+
+**Parameters**
+    - *fragment : decrypted fragment with its header
+    - length : length of the fragment
+    - *addr : source of the fragment
+
+**Description**
+    Copy the data to its place in a reassembly buffer.
+    Deliver the message once all fragments arrived. Malformed
+    fragments and fragments that find no free buffer are
+    dropped.
+*/
+void reassemble(const byte_t *fragment, int length, const struct sockaddr_in *addr) {
+    TickType_t now = xTaskGetTickCount();
+    reassembly_t *slot;
+    uint16_t id;
+    int index;
+    int count;
+    int data_len = length - FRAGMENT_HEADER_LENGTH;
+
+    if (data_len <= 0) {
+        num_fragments_dropped++;
+        return;
+    }
+    id = (fragment[1] << 8) | fragment[2];
+    index = fragment[3] - 1;
+    count = fragment[4];
+
+    // every fragment but the last is full
+    if (count < 2 || count > MAX_FRAGMENTS || index < 0 || index >= count ||
+        (index < count - 1 && data_len != FRAGMENT_DATA_LENGTH) ||
+        index * FRAGMENT_DATA_LENGTH + data_len > CONFIG_UDP_MAX_MESSAGE_LENGTH) {
+        ESP_LOGD(TAG, "malformed fragment %d of %d", index + 1, count);
+        num_fragments_dropped++;
+        return;
+    }
+
+    expire_reassemblies(now);
+    slot = find_reassembly(addr->sin_addr.s_addr, addr->sin_port, id, count, now);
+    if (slot == NULL) {
+        ESP_LOGW(TAG, "no free reassembly buffer for message %u", id);
+        num_fragments_dropped++;
+        return;
+    }
+    if (slot->count != count) {
+        num_fragments_dropped++;
+        return;
+    }
+    if (slot->received & ((uint32_t)1 << index)) {
+        // duplicate
+        return;
+    }
+
+    memcpy(slot->message + index * FRAGMENT_DATA_LENGTH,
+           fragment + FRAGMENT_HEADER_LENGTH,
+           data_len);
+    slot->received |= (uint32_t)1 << index;
+    if (index == count - 1) {
+        slot->length = index * FRAGMENT_DATA_LENGTH + data_len;
+    }
+
+    if (slot->received == ((uint32_t)1 << count) - 1) {
+        ESP_LOGD(TAG, "reassembled message %u of %d bytes", id, slot->length);
+        deliver(slot->message, slot->length, addr);
+        slot->used = false;
+    }
+}
+
+// getters of the registry entries
+int32_t get_num_replayed() {
+    return num_replayed;
+}
+
+int32_t get_num_forged() {
+    return num_forged;
+}
+
+int32_t get_num_fragments_dropped() {
+    return num_fragments_dropped;
+}
+
+int32_t get_num_unacked() {
+    return num_unacked;
+}
+
+int32_t get_rto() {
+    return rto / 1000;
+}
+
+int32_t get_num_bad_length() {
+    return num_bad_length;
+}
+
+int32_t get_num_rate_limited() {
+    return num_rate_limited;
+}
+
+int32_t get_num_busy() {
+    return num_busy;
+}
+
+// queue depths, read without the locks as a snapshot
+int32_t get_in_flight() {
+    return in_flight;
+}
+
+int32_t get_num_outgoing() {
+    int32_t num = 0;
+
+    for (int i = 0; i < CONFIG_UDP_RELIABLE_WINDOW; i++) {
+        num += outgoing[i].used;
+    }
+    return num;
+}
+
+static const registry_entry_t replayed_entry = {
+    .name = "udp_replayed",
+    .type = REGISTRY_INT,
+    .get = get_num_replayed};
+
+static const registry_entry_t forged_entry = {
+    .name = "udp_forged",
+    .type = REGISTRY_INT,
+    .get = get_num_forged};
+
+static const registry_entry_t fragments_dropped_entry = {
+    .name = "udp_fragments_dropped",
+    .type = REGISTRY_INT,
+    .get = get_num_fragments_dropped};
+
+static const registry_entry_t unacked_entry = {
+    .name = "udp_unacked",
+    .type = REGISTRY_INT,
+    .get = get_num_unacked};
+
+static const registry_entry_t rto_entry = {
+    .name = "udp_rto",
+    .type = REGISTRY_INT,
+    .get = get_rto};
+
+static const registry_entry_t bad_length_entry = {
+    .name = "udp_bad_length",
+    .type = REGISTRY_INT,
+    .get = get_num_bad_length};
+
+static const registry_entry_t rate_limited_entry = {
+    .name = "udp_rate_limited",
+    .type = REGISTRY_INT,
+    .get = get_num_rate_limited};
+
+static const registry_entry_t busy_entry = {
+    .name = "udp_busy",
+    .type = REGISTRY_INT,
+    .get = get_num_busy};
+
+static const registry_entry_t in_flight_entry = {
+    .name = "udp_in_flight",
+    .type = REGISTRY_INT,
+    .get = get_in_flight};
+
+static const registry_entry_t outgoing_entry = {
+    .name = "udp_outgoing",
+    .type = REGISTRY_INT,
+    .get = get_num_outgoing};
+
+// PUBLIC FUNCTIONS
 
 void pl_udp_init(int port) {
     ESP_LOGI(TAG, "init starting");
@@ -79,6 +1246,29 @@ void pl_udp_init(int port) {
     // Create and bind the sockets in the event handler. Use
     // sendto() or recvfrom() to transmitt or receive from
     // socket.
+
+    // state of the reliable messages
+    const esp_timer_create_args_t timer_args = {
+        .callback = &reliable_timeout,
+        .name = "udp-reliable"};
+    reliable_lock = xSemaphoreCreateMutex();
+    log_status(TAG,
+               esp_timer_create(&timer_args, &reliable_timer),
+               "create reliable timer");
+
+    // report the dropped frames by the stage that dropped
+    // them
+    registry_register(&bad_length_entry);
+    registry_register(&rate_limited_entry);
+    registry_register(&replayed_entry);
+    registry_register(&forged_entry);
+    registry_register(&fragments_dropped_entry);
+    registry_register(&unacked_entry);
+    registry_register(&rto_entry);
+    registry_register(&busy_entry);
+    registry_register(&in_flight_entry);
+    registry_register(&outgoing_entry);
+
     ESP_LOGI(TAG, "init finished");
 }
 
@@ -91,6 +1281,13 @@ void pl_udp_handler(void *arg,
     if (base == IP_EVENT) {
         switch (id) {
             case IP_EVENT_STA_GOT_IP:
+                // after a reconnect the old socket is bound
+                // to the lost address
+                if (sock >= 0) {
+                    udp_ready = false;
+                    close(sock);
+                    sock = -1;
+                }
 
                 // create IPv4 socket and get file
                 // descriptor
@@ -122,12 +1319,6 @@ void pl_udp_handler(void *arg,
                                  ntohs(rx_addr.sin_port));
 
                         udp_ready = true;
-
-                        // get time syncronization
-                        sntp_setoperatingmode(SNTP_OPMODE_POLL);
-                        sntp_setservername(0, "pool.ntp.org");
-                        sntp_init();
-                        ESP_LOGV(TAG, "starting sntp_init");
                     }
                 }
                 break;
@@ -139,63 +1330,123 @@ void pl_udp_handler(void *arg,
 
         pl_udp_send("{\"type\":\"hello world\"}");
 
-        // start listening
-        xTaskCreate(pl_udp_receive,
-                    "udp-receive",
-                    4096,
-                    NULL,
-                    1,
-                    NULL);
+        // start listening, the task survives reconnects
+        if (receive_task == NULL) {
+            xTaskCreate(pl_udp_receive,
+                        "udp-receive",
+                        4096,
+                        NULL,
+                        1,
+                        &receive_task);
+        }
     }
 }
 
 void pl_udp_send(const char *msg) {
-    byte_t *ciphertext;
+    broadcast(msg, AL_CRYPTO_ACTIVE_KEY);
+}
+
+void pl_udp_reply(const pl_udp_message_t *request, const char *msg) {
     int msg_len = strlen(msg);
-    int cipher_len;
+    char stamp[STAMP_LENGTH];
+    int stamp_len;
+    outgoing_t *slot = NULL;
+    struct sockaddr_in to;
 
-    // check if the message can be encrypted
-    if (msg_len >= BUFFER_LENGTH) {
+    if (request == NULL) {
+        pl_udp_send(msg);
+        return;
+    }
+    if (request->seq == 0) {
+        broadcast(msg, request->key_id);
+        return;
+    }
+
+    if (msg_len + RELIABLE_HEADER_LENGTH + STAMP_LENGTH > CONFIG_UDP_MAX_MESSAGE_LENGTH) {
         ESP_LOGW(TAG,
-                 "cannot send a message of length %d bytes, maximum is %d bytes. Aborting sending!",
+                 "cannot send a reply of length %d bytes, maximum is %d bytes. Aborting sending!",
                  msg_len,
-                 BUFFER_LENGTH - 1);
+                 CONFIG_UDP_MAX_MESSAGE_LENGTH - RELIABLE_HEADER_LENGTH - STAMP_LENGTH);
         return;
-    } else {
-        ESP_LOGV(TAG, "plain message: %s", msg);
     }
-    // encrypt and reuse the length of the ciphertext
-    ciphertext = al_crypto_encrypt((byte_t *)msg);
-    cipher_len = BUFFER_LENGTH + 15;
+    ESP_LOGV(TAG, "plain reply: %s", msg);
 
-    // check if socket was created
-    if (sock >= 0 && udp_ready == true) {
-        // send message via socket
-        int err = sendto(sock,
-                         ciphertext,
-                         cipher_len,
-                         0,
-                         (struct sockaddr *)&tx_addr,
-                         tx_addr_len);
+    xSemaphoreTake(reliable_lock, portMAX_DELAY);
 
-        if (err < 0) {
-            ESP_LOGE(TAG,
-                     "unable to send message error %d",
-                     err);
-        } else {
-            ESP_LOGD(TAG,
-                     "<< %s:%d (%d bytes, %.2f words)",
-                     inet_ntoa(tx_addr.sin_addr.s_addr),
-                     ntohs(tx_addr.sin_port),
-                     cipher_len,
-                     (double)cipher_len / 16.);
+    // the reply carries the ack of the request
+    take_ack(request->addr, request->port, request->seq);
+    for (int i = 0; i < CONFIG_UDP_RELIABLE_WINDOW; i++) {
+        if (!outgoing[i].used) {
+            slot = &outgoing[i];
+            break;
         }
     }
+
+    if (slot == NULL) {
+        // window is full, ack the request and send the reply
+        // unreliably
+        ESP_LOGW(TAG, "reliable window is full");
+        send_ack(request->addr, request->port, request->seq, request->key_id);
+        xSemaphoreGive(reliable_lock);
+        broadcast(msg, request->key_id);
+        return;
+    }
+
+    reliable_seq = (reliable_seq % RELIABLE_SEQ_MAX) + 1;
+    make_addr(&to, request->addr, request->port);
+    slot->to = to;
+    slot->seq = reliable_seq;
+    slot->key_id = request->key_id;
+    slot->sent = esp_timer_get_time();
+    slot->rto = rto;
+    slot->deadline = slot->sent + rto;
+    slot->retries = 0;
+    slot->used = true;
+    slot->message[0] = RELIABLE_MARKER;
+    write_seq(slot->message + 1, slot->seq);
+    write_seq(slot->message + 3, request->seq);
+    // retransmissions keep the stamp of the first
+    // transmission
+    stamp_len = stamp_message(msg, &msg_len, stamp, false);
+    memcpy(slot->message + RELIABLE_HEADER_LENGTH, msg, msg_len);
+    memcpy(slot->message + RELIABLE_HEADER_LENGTH + msg_len, stamp, stamp_len);
+    slot->length = RELIABLE_HEADER_LENGTH + msg_len + stamp_len;
+
+    send_message(slot->message, slot->length, NULL, 0, slot->key_id, &slot->to);
+    arm_reliable_timer();
+    xSemaphoreGive(reliable_lock);
+}
+
+int64_t pl_udp_last_sent() {
+    int64_t time;
+
+    portENTER_CRITICAL(&stamp_lock);
+    time = last_sent;
+    portEXIT_CRITICAL(&stamp_lock);
+    return time;
+}
+
+void pl_udp_done() {
+    portENTER_CRITICAL(&in_flight_lock);
+    if (in_flight > 0) {
+        in_flight--;
+    }
+    portEXIT_CRITICAL(&in_flight_lock);
 }
 
 void pl_udp_receive() {
     byte_t *plaintext;
+    int plain_len;
     int len;
+    uint32_t sender;
+    uint64_t sequence;
+    bool sequenced;
+    const uint8_t *ip;
+    int64_t start;
+    esp_err_t err;
+    // sender of the frame
+    struct sockaddr_in from;
+    socklen_t from_len;
 
     // listening loop to start this function as a task
     while (1) {
@@ -203,43 +1454,81 @@ void pl_udp_receive() {
         if (sock >= 0 && udp_ready == true) {
             // receive message from bound socket and save in
             // rx_buffer
+            // one byte more to detect longer datagrams
+            from_len = sizeof(from);
             len = recvfrom(sock,
                            rx_buffer,
-                           sizeof(rx_buffer) - 1,
+                           AL_CRYPTO_FRAME_LENGTH + 1,
                            0,
-                           (struct sockaddr *)&rx_addr,
-                           &rx_addr_len);
+                           (struct sockaddr *)&from,
+                           &from_len);
+            rx_time = esp_timer_get_time();
 
             if (len < 0) {
                 ESP_LOGW(TAG,
                          "unable to receive message error %d",
                          len);
             } else {
-                // null terminate buffer
-                rx_buffer[len] = 0;
-
                 // get ip address of sender in buffer ip_addr
-                inet_ntoa_r(((struct sockaddr_in *)&rx_addr)->sin_addr.s_addr,
+                inet_ntoa_r(from.sin_addr.s_addr,
                             ip_addr,
                             sizeof(ip_addr) - 1);
 
                 // print message
-                ESP_LOGV(TAG,
-                         ">> %s:%d (%d bytes, %.2f words)",
-                         ip_addr,
-                         ntohs(rx_addr.sin_port),
-                         len,
-                         (double)len / 16.);
-
-                plaintext = al_crypto_decrypt((byte_t *)rx_buffer, len);
-                ESP_LOGV(TAG, "message: '%s'", plaintext);
-
-                esp_event_post(UDP_EVENT,
-                               UDP_EVENT_RECEIVED,
-                               plaintext,
-                               sizeof(plaintext) * strlen((char *)plaintext),
-                               portMAX_DELAY);
+                ip = (const uint8_t *)&from.sin_addr.s_addr;
+                LOGGER_V(TAG,
+                         ">> %u.%u.%u.%u:%u (%d bytes)",
+                         ip[0], ip[1], ip[2], ip[3],
+                         ntohs(from.sin_port),
+                         len);
+
+                // admission from the cheapest to the most
+                // expensive check: length, rate of the
+                // source, replay and the decryption
+                if (!al_crypto_check_length(len)) {
+                    num_bad_length++;
+                    ESP_LOGD(TAG, "dropped frame of %d bytes", len);
+                    continue;
+                }
+                if (!rate_admit(from.sin_addr.s_addr)) {
+                    num_rate_limited++;
+                    ESP_LOGD(TAG, "dropped frame above the rate of %s", ip_addr);
+                    continue;
+                }
+
+                // drop duplicates and replays before the
+                // decryption
+                sequenced = (al_crypto_get_sequence(rx_buffer, len, &sender, &sequence) == ESP_OK);
+                if (sequenced && replay_seen(sender, sequence)) {
+                    num_replayed++;
+                    ESP_LOGD(TAG, "dropped replay %llu of sender %08x", sequence, sender);
+                    continue;
+                }
+
+                start = esp_timer_get_time();
+                err = al_crypto_decrypt(rx_buffer, len, &plaintext, &plain_len);
+                metrics_record(METRICS_DECRYPT, esp_timer_get_time() - start);
+                if (err != ESP_OK) {
+                    if (err == ESP_ERR_INVALID_CRC) {
+                        num_forged++;
+                    }
+                    continue;
+                }
+                // only an authenticated frame moves the window
+                if (sequenced) {
+                    replay_accept(sender, sequence);
+                }
+                // the reply goes out with the same key
+                rx_key = al_crypto_get_key_id(rx_buffer, len);
+                if (plain_len > 0 && plaintext[0] == FRAGMENT_MARKER) {
+                    reassemble(plaintext, plain_len, &from);
+                } else {
+                    deliver((char *)plaintext, plain_len, &from);
+                }
             }
+        } else {
+            // wait for the socket of the next IP address
+            vTaskDelay(100 / portTICK_PERIOD_MS);
         }
     }
 }
\ No newline at end of file
@@ -14,6 +14,23 @@ typedef enum {
     UDP_EVENT_RECEIVED
 } udp_event_t;
 
+// data of the event UDP_EVENT_RECEIVED
+typedef struct pl_udp_message_t {
+    // source of the message in network byte order
+    uint32_t addr;
+    uint16_t port;
+    // sequence number of a reliable message, 0 otherwise
+    uint16_t seq;
+    // id of the key of the message, the reply is encrypted
+    // with the same key
+    uint8_t key_id;
+    // time of `esp_timer_get_time` when the last frame of
+    // the message arrived
+    int64_t received;
+    // the null terminated message
+    char text[];
+} pl_udp_message_t;
+
 /** Init of UDP component.
 
 **Parameter**
@@ -58,27 +75,97 @@ void pl_udp_handler(void* arg,
 **Requirements**
     UDP must be init and flag `udp_ready` has to be true.
     Encryption must be initialized. The length of `msg` has
-    to be less than the buffer length.
+    to be at most `CONFIG_UDP_MAX_MESSAGE_LENGTH`.
 
 **Description**
-    Encrypt the message. Send UDP message via socket and 
-    `sendto()` to ip address set in `pl_udp_init()`.
+    Copy the message into a frame on the stack and encrypt
+    it there. Send UDP message via socket and 
+    `sendto()` to ip address set in `pl_udp_init()`. A
+    message longer than `AL_CRYPTO_MESSAGE_LENGTH` is split
+    into fragments that are each encrypted and sent as one
+    frame, a shorter message is sent as it is.
+    A JSON object gets the members `uptime` in seconds and
+    `seq`, a sequence number of all broadcasts, added at
+    its end. 40 bytes of the maximum length are reserved
+    for them.
 */
 void pl_udp_send(const char* msg);
 
+/** Reply to a received message.
+
+**Parameters**
+    - *request : the received message or NULL
+    - *msg : the reply
+
+**Requirements**
+    Same as `pl_udp_send()`.
+
+**Description**
+    Every frame of the reply and its retransmissions is
+    encrypted with the key of the request. Broadcast the
+    reply like `pl_udp_send()` if the request was not
+    reliable. Otherwise send it to the source of the
+    request with the ack of the request and a sequence
+    number of its own. Its `seq` stamp counts the replies
+    to clients, not the broadcasts. The reply is kept in a
+    window of `CONFIG_UDP_RELIABLE_WINDOW` messages and
+    retransmitted until the client acks it, with a timeout
+    from the measured round trip times that doubles with
+    every try.
+    If the window is full the request is acked alone and
+    the reply is broadcast unreliably.
+*/
+void pl_udp_reply(const pl_udp_message_t *request, const char *msg);
+
+/** Get the time the last message was sent.
+
+**Return**
+    Time of `esp_timer_get_time` in microseconds when the
+    last broadcast was stamped by `pl_udp_send()`, 0 if
+    none was sent yet.
+
+**Description**
+    Every broadcast shows the collector that the station is
+    alive, so the heartbeat is only needed after an idle
+    period. Replies to a single client do not count.
+*/
+int64_t pl_udp_last_sent();
+
+/** Finish a received message.
+
+**Requirements**
+    The handler of UDP_EVENT_RECEIVED must call this once
+    for every message when it is done with it.
+
+**Description**
+    Count the message as no longer in flight, so the receive
+    task accepts a new one.
+*/
+void pl_udp_done();
+
 /** Receive encrypted data via UDP and print to log.
 
 **Requirements**
-    UDP must be init and flag `udp_read` true. The length
-    of the incoming UDP message must be a multiple of 16.
-    Maximum length is given by the buffer length.
+    UDP must be init and flag `udp_read` true. The incoming
+    UDP message must be a frame of `al_crypto` of at most
+    `AL_CRYPTO_FRAME_LENGTH` bytes.
 
 **Description**
     Run loop for ever in a task.
     Receive bytes via socket and `recfrom()` from ip address
-    set in `pl_udp_init()`. Decrypt the message. Log message 
+    set in `pl_udp_init()`. Decrypt the message in place. Log message 
     to esp log output as VERBOSE. Post a new udp event with 
-    id UDP_EVENT_RECEIVED with the message as the data.
+    id UDP_EVENT_RECEIVED with a `pl_udp_message_t` as the
+    data. Fragments are collected in a reassembly buffer per
+    message and the message is posted once all of them
+    arrived. A reliable message is acked with the reply to
+    it or alone after `CONFIG_UDP_ACK_DELAY`, a duplicate is
+    acked again but not posted.
+    Frames of an impossible length and frames above the rate
+    limit of their source address are dropped before they
+    are decrypted. If `CONFIG_UDP_MAX_IN_FLIGHT` messages
+    are not finished by the application a new message is
+    answered with a `busy` error and not posted.
 */
 void pl_udp_receive();
 
@@ -0,0 +1,127 @@
+// MISCELLANEOUS
+// Source file of the registry component.
+
+#include "./registry.h"
+
+#include <string.h>
+
+#include "../general/general.h"
+
+// number of slots of the hash table, a power of two with at
+// least twice the number of entries
+#define REGISTRY_SLOTS (2 * REGISTRY_MAX_ENTRIES)
+
+static const char *TAG = "registry";
+
+// entries in the order of registration
+static const registry_entry_t *entries[REGISTRY_MAX_ENTRIES];
+static int num_entries = 0;
+
+// open addressing hash table of the entries
+static const registry_entry_t *slots[REGISTRY_SLOTS];
+
+// PRIVATE FUNCTIONS
+
+/** FNV-1a hash of a string.
+
+**Parameters**
+    - *string : null terminated string
+
+**Return**
+    32 bit hash value.
+*/
+uint32_t hash_string(const char *string) {
+    uint32_t hash = 2166136261u;
+
+    while (*string) {
+        hash ^= (uint8_t)*string++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/** Find the slot of a name.
+
+**Parameters**
+    - *name : name of the variable
+
+**Return**
+    Index of the slot that holds the name or of the empty
+    slot where it would be inserted.
+*/
+uint32_t find_slot(const char *name) {
+    uint32_t slot = hash_string(name) & (REGISTRY_SLOTS - 1);
+
+    // linear probing, terminates because the table is never
+    // full
+    while (slots[slot] != NULL && 0 != strcmp(slots[slot]->name, name)) {
+        slot = (slot + 1) & (REGISTRY_SLOTS - 1);
+    }
+    return slot;
+}
+
+// PUBLIC FUNCTIONS
+
+void registry_register(const registry_entry_t *entry) {
+    uint32_t slot;
+
+    if (num_entries >= REGISTRY_MAX_ENTRIES) {
+        ESP_LOGE(TAG, "registry is full, cannot register %s", entry->name);
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+
+    slot = find_slot(entry->name);
+    if (slots[slot] != NULL) {
+        ESP_LOGE(TAG, "variable %s is already registered", entry->name);
+        ESP_ERROR_CHECK(ESP_ERR_INVALID_STATE);
+    }
+
+    slots[slot] = entry;
+    entries[num_entries++] = entry;
+    ESP_LOGD(TAG, "registered %s in slot %u", entry->name, slot);
+}
+
+const registry_entry_t *registry_find(const char *name) {
+    return slots[find_slot(name)];
+}
+
+const registry_entry_t *registry_get(int index) {
+    if (index < 0 || index >= num_entries) {
+        return NULL;
+    }
+    return entries[index];
+}
+
+esp_err_t registry_set_int(const char *name, int32_t value) {
+    const registry_entry_t *entry = registry_find(name);
+
+    if (entry == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (entry->type != REGISTRY_INT || entry->set == NULL ||
+        value < entry->min || value > entry->max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return entry->set(value);
+}
+
+esp_err_t registry_set_string(const char *name, const char *value) {
+    const registry_entry_t *entry = registry_find(name);
+
+    if (entry == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (entry->type == REGISTRY_STRING && entry->set_string != NULL) {
+        return entry->set_string(value);
+    }
+    if (entry->type != REGISTRY_BOOL || entry->set == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (0 == strcmp(value, "on")) {
+        return entry->set(1);
+    } else if (0 == strcmp(value, "off")) {
+        return entry->set(0);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,125 @@
+// MISCELLANEOUS
+// Header file of the registry component.
+
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// maximum number of registered variables, with room for
+// new components on top of the about 30 of the application
+#define REGISTRY_MAX_ENTRIES 64
+
+// type of a variable
+typedef enum {
+    // integer within the bounds of the entry
+    REGISTRY_INT,
+    // switch with the string values `on` and `off`
+    REGISTRY_BOOL,
+    // string that is passed to `set_string` as it is
+    REGISTRY_STRING
+} registry_type_t;
+
+// description of a variable that can be read and set by
+// requests. entries are defined `static const` by the
+// component that owns the variable.
+typedef struct registry_entry_t {
+    const char *name;
+    registry_type_t type;
+    // inclusive bounds of an integer value
+    int32_t min;
+    int32_t max;
+    // read the current value, 0 or 1 for a switch, NULL for
+    // a write only variable that is not listed
+    int32_t (*get)(void);
+    // apply a new value that is within the bounds, NULL for
+    // a read only variable
+    esp_err_t (*set)(int32_t value);
+    // apply a new value of a string variable
+    esp_err_t (*set_string)(const char *value);
+    // only set by requests that are encrypted with the
+    // active key, like the keys themselves
+    bool admin;
+} registry_entry_t;
+
+/** Register a variable.
+
+**Parameters**
+    - *entry : the entry, must stay valid forever
+
+**Description**
+    Insert the entry into the hash table by the FNV-1a hash
+    of its name. Components call this from their init. A
+    full registry or a taken name is a bug of the build, it
+    aborts at the boot instead of leaving a variable that
+    cannot be read or set.
+*/
+void registry_register(const registry_entry_t *entry);
+
+/** Find a variable by its name.
+
+**Parameters**
+    - *name : name of the variable
+
+**Return**
+    The entry or NULL if no variable has the name.
+
+**Description**
+    Hash the name and probe the open addressing table, which
+    is never more than half full. The cost does not depend
+    on the number of variables.
+*/
+const registry_entry_t *registry_find(const char *name);
+
+/** Get a variable by its registration index.
+
+**Parameters**
+    - index : from 0 to the number of variables - 1
+
+**Return**
+    The entry or NULL if the index is out of range.
+
+**Description**
+    Use this to iterate over all variables in the order
+    they were registered.
+*/
+const registry_entry_t *registry_get(int index);
+
+/** Set a variable to an integer value.
+
+**Parameters**
+    - *name : name of the variable
+    - value : new value
+
+**Return**
+    - err:
+        `ESP_ERR_NOT_FOUND` for an unknown name,
+        `ESP_ERR_INVALID_ARG` if the variable is no integer
+        or the value is out of bounds and the result of the
+        setter otherwise
+*/
+esp_err_t registry_set_int(const char *name, int32_t value);
+
+/** Set a variable to a string value.
+
+**Parameters**
+    - *name : name of the variable
+    - *value : new value, `on` or `off` for a switch
+
+**Return**
+    - err:
+        `ESP_ERR_NOT_FOUND` for an unknown name,
+        `ESP_ERR_INVALID_ARG` if the variable takes no string
+        or the value is not valid and the result of the
+        setter otherwise
+
+**Description**
+    A switch takes `on` and `off`, a string variable checks
+    the value in its own setter.
+*/
+esp_err_t registry_set_string(const char *name, const char *value);
+
+#endif  // _REGISTRY_H_
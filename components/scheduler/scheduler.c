@@ -0,0 +1,255 @@
+// MISCELLANEOUS
+// Source file of the scheduler component.
+
+#include "./scheduler.h"
+
+#include "../general/general.h"
+#include "../registry/registry.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// jobs that are due within this time of a wake up run in
+// that wake up, in microseconds
+#define SCHEDULER_SLACK 20000
+
+// a periodic job, times are monotonic microseconds of
+// `esp_timer_get_time`
+typedef struct scheduler_job_t {
+    const char *name;
+    scheduler_callback_t callback;
+    int64_t period;
+    // time the last run was due
+    int64_t last;
+    // time the next run is due
+    int64_t next;
+    bool running;
+} scheduler_job_t;
+
+static const char *TAG = "scheduler";
+
+static scheduler_job_t jobs[SCHEDULER_MAX_JOBS];
+static int num_jobs = 0;
+
+// one shot timer for the earliest due job
+static esp_timer_handle_t scheduler_timer;
+// protects the jobs, the callbacks run without it
+static SemaphoreHandle_t scheduler_lock;
+
+static uint32_t num_wakeups = 0;
+// runs that were skipped because a job was late by at least
+// one period
+static uint32_t num_overruns = 0;
+
+// PRIVATE FUNCTIONS
+
+/** Get the time of the next run of a job.
+
+**Parameters**
+    - *job : the job
+    - now : current monotonic time
+
+**Return**
+    Monotonic time of the next run.
+
+**Description**
+    With a synchronized clock this is the next multiple of
+    the period since the epoch that is not within the slack
+    of now, so a job that runs a little early does not run
+    twice. Otherwise it is one period after the last run.
+*/
+int64_t next_time(const scheduler_job_t *job, int64_t now) {
+    int64_t epoch;
+    int64_t next;
+
+    if (get_time_quality() != TIME_UNSYNCED) {
+        epoch = monotonic_to_epoch_us(now) + SCHEDULER_SLACK;
+        return now + SCHEDULER_SLACK + job->period - epoch % job->period;
+    }
+
+    next = job->last + job->period;
+    // start a new phase after an overrun
+    return next > now ? next : now + job->period;
+}
+
+/** Arm the timer for the earliest due job.
+
+**Requirements**
+    Hold the `scheduler_lock`.
+*/
+void arm_timer() {
+    int64_t next = INT64_MAX;
+    int64_t delay;
+
+    for (int j = 0; j < num_jobs; j++) {
+        if (jobs[j].running && jobs[j].next < next) {
+            next = jobs[j].next;
+        }
+    }
+
+    // fails harmlessly if the timer is not armed
+    esp_timer_stop(scheduler_timer);
+    if (next == INT64_MAX) {
+        return;
+    }
+
+    delay = next - esp_timer_get_time();
+    log_status(TAG,
+               esp_timer_start_once(scheduler_timer, delay > 0 ? delay : 1),
+               "arm scheduler timer");
+}
+
+/** Function gets called when the timer runs out.
+
+**Description**
+    Run all jobs that are due within the slack in one wake
+    up, count the runs that late jobs missed and arm the
+    timer for the next job. The callbacks run without the
+    lock so they may change the jobs.
+*/
+void scheduler_wakeup(void *arg) {
+    scheduler_job_t *due[SCHEDULER_MAX_JOBS];
+    int num_due = 0;
+    scheduler_job_t *job;
+    int64_t now;
+    int64_t late;
+    int64_t duration;
+
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    now = esp_timer_get_time();
+    num_wakeups++;
+    for (int j = 0; j < num_jobs; j++) {
+        job = &jobs[j];
+        if (!job->running || job->next > now + SCHEDULER_SLACK) {
+            continue;
+        }
+
+        late = now - job->next;
+        if (late >= job->period) {
+            num_overruns += late / job->period;
+            ESP_LOGW(TAG, "%s missed %d runs", job->name, (int)(late / job->period));
+        }
+        job->last = job->next;
+        job->next = next_time(job, now);
+        due[num_due++] = job;
+    }
+    xSemaphoreGive(scheduler_lock);
+
+    ESP_LOGD(TAG, "%d jobs due", num_due);
+    for (int d = 0; d < num_due; d++) {
+        now = esp_timer_get_time();
+        due[d]->callback();
+        duration = esp_timer_get_time() - now;
+        if (duration > due[d]->period) {
+            // counted as missed runs on the next wake up
+            ESP_LOGW(TAG, "%s ran longer than its period", due[d]->name);
+        }
+    }
+
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    arm_timer();
+    xSemaphoreGive(scheduler_lock);
+}
+
+// getters of the registry entries
+int32_t scheduler_get_wakeups() {
+    return num_wakeups;
+}
+
+int32_t scheduler_get_overruns() {
+    return num_overruns;
+}
+
+static const registry_entry_t scheduler_wakeups_entry = {
+    .name = "scheduler_wakeups",
+    .type = REGISTRY_INT,
+    .get = scheduler_get_wakeups};
+
+static const registry_entry_t scheduler_overruns_entry = {
+    .name = "scheduler_overruns",
+    .type = REGISTRY_INT,
+    .get = scheduler_get_overruns};
+
+// PUBLIC FUNCTIONS
+
+void scheduler_init() {
+    const esp_timer_create_args_t scheduler_timer_args = {
+        .callback = &scheduler_wakeup,
+        .name = "scheduler"};
+
+    scheduler_lock = xSemaphoreCreateMutex();
+    log_status(TAG,
+               esp_timer_create(&scheduler_timer_args, &scheduler_timer),
+               "create scheduler timer");
+
+    registry_register(&scheduler_wakeups_entry);
+    registry_register(&scheduler_overruns_entry);
+}
+
+esp_err_t scheduler_add(const char *name,
+                        uint32_t period,
+                        scheduler_callback_t callback,
+                        int *job) {
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    if (num_jobs >= SCHEDULER_MAX_JOBS) {
+        xSemaphoreGive(scheduler_lock);
+        ESP_LOGW(TAG, "no job left for %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *job = num_jobs;
+    jobs[num_jobs].name = name;
+    jobs[num_jobs].callback = callback;
+    jobs[num_jobs].period = (int64_t)period * 1000000;
+    jobs[num_jobs].running = false;
+    num_jobs++;
+    xSemaphoreGive(scheduler_lock);
+
+    ESP_LOGD(TAG, "added %s every %u s", name, period);
+    return ESP_OK;
+}
+
+void scheduler_start(int job) {
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    jobs[job].last = now;
+    jobs[job].next = next_time(&jobs[job], now);
+    jobs[job].running = true;
+    arm_timer();
+    xSemaphoreGive(scheduler_lock);
+
+    ESP_LOGD(TAG, "started %s", jobs[job].name);
+}
+
+void scheduler_stop(int job) {
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    jobs[job].running = false;
+    arm_timer();
+    xSemaphoreGive(scheduler_lock);
+
+    ESP_LOGD(TAG, "stopped %s", jobs[job].name);
+}
+
+void scheduler_set_period(int job, uint32_t period) {
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    jobs[job].period = (int64_t)period * 1000000;
+    if (jobs[job].running) {
+        jobs[job].next = next_time(&jobs[job], esp_timer_get_time());
+        arm_timer();
+    }
+    xSemaphoreGive(scheduler_lock);
+}
+
+void scheduler_postpone(int job, int64_t until) {
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    if (jobs[job].running) {
+        jobs[job].next = until;
+        arm_timer();
+    }
+    xSemaphoreGive(scheduler_lock);
+}
+
+bool scheduler_is_running(int job) {
+    return jobs[job].running;
+}
@@ -0,0 +1,106 @@
+// MISCELLANEOUS
+// Header file of the scheduler component.
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// maximum number of periodic jobs
+#define SCHEDULER_MAX_JOBS 8
+
+// function of a job, runs in the task of the esp_timer
+typedef void (*scheduler_callback_t)(void);
+
+/** Initialize the scheduler.
+
+**Description**
+    Create the one shot esp_timer that wakes up for the next
+    due job and register the read only variables
+    `scheduler_wakeups` and `scheduler_overruns`.
+*/
+void scheduler_init();
+
+/** Add a periodic job.
+
+**Parameters**
+    - *name : name for the log messages
+    - period : period in seconds
+    - callback : function that is called when the job is due
+    - *job : output for the handle of the job
+
+**Return**
+    - err:
+        `ESP_ERR_NO_MEM` if all jobs are taken and `ESP_OK`
+        otherwise
+
+**Description**
+    The job is stopped until `scheduler_start` is called.
+*/
+esp_err_t scheduler_add(const char *name,
+                        uint32_t period,
+                        scheduler_callback_t callback,
+                        int *job);
+
+/** Start a job.
+
+**Parameters**
+    - job : handle from `scheduler_add`
+
+**Description**
+    Once the system time is synchronized with SNTP the job
+    runs at the multiples of its period since the epoch, so
+    jobs with the same period or periods that divide each
+    other wake up together and all stations sample at the
+    same wall clock times. Before that the job first runs
+    one period from now.
+*/
+void scheduler_start(int job);
+
+/** Stop a job.
+
+**Parameters**
+    - job : handle from `scheduler_add`
+*/
+void scheduler_stop(int job);
+
+/** Change the period of a job.
+
+**Parameters**
+    - job : handle from `scheduler_add`
+    - period : new period in seconds
+
+**Description**
+    A running job is not restarted from now but moved to the
+    next aligned time of the new period, or to one new period
+    after its last run while the time is not synchronized.
+*/
+void scheduler_set_period(int job, uint32_t period);
+
+/** Postpone the next run of a job.
+
+**Parameters**
+    - job : handle from `scheduler_add`
+    - until : time of `esp_timer_get_time` in microseconds
+
+**Description**
+    Run a running job next at `until` instead of its aligned
+    time. The runs after that are aligned again. A job may
+    postpone itself from its callback.
+*/
+void scheduler_postpone(int job, int64_t until);
+
+/** Check if a job is running.
+
+**Parameters**
+    - job : handle from `scheduler_add`
+
+**Return**
+    True between `scheduler_start` and `scheduler_stop`.
+*/
+bool scheduler_is_running(int job);
+
+#endif  // _SCHEDULER_H_
@@ -0,0 +1,294 @@
+// MISCELLANEOUS
+// Source file of the time sync component.
+
+#include "./timesync.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../general/general.h"
+#include "../registry/registry.h"
+#include "esp_attr.h"
+#include "esp_netif.h"
+#include "esp_sntp.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+
+// marks valid data in the RTC memory
+#define TIMESYNC_MAGIC 0x54494d45
+// minimum time between the synchronizations of a drift
+// estimate in microseconds, the network delay varies by
+// milliseconds
+#define DRIFT_MIN_SPAN (3600 * 1000000LL)
+// change of the drift in ppb before it is written to NVS
+#define DRIFT_SAVE_STEP 1000
+// a synchronization older than this many poll intervals is
+// stale
+#define STALE_INTERVALS 3
+// maximum time to wait for the event queue in milliseconds
+#define POST_TIMEOUT 10
+
+// state that survives a reset in the RTC memory
+typedef struct timesync_rtc_t {
+    uint32_t magic;
+    // system time of the last synchronization in
+    // microseconds since the epoch
+    int64_t last_sync;
+} timesync_rtc_t;
+
+static const char *TAG = "timesync";
+
+ESP_EVENT_DEFINE_BASE(TIMESYNC_EVENT);
+
+// not initialized at boot, checked by the magic
+RTC_NOINIT_ATTR static timesync_rtc_t rtc_state;
+
+static const char *const servers[] = {
+    CONFIG_TIMESYNC_SERVER_1,
+    CONFIG_TIMESYNC_SERVER_2,
+    CONFIG_TIMESYNC_SERVER_3};
+#define NUM_SERVERS (sizeof(servers) / sizeof(servers[0]))
+
+// the notification runs in the lwip task, the getters in
+// any task
+static portMUX_TYPE sync_lock = portMUX_INITIALIZER_UNLOCKED;
+// synchronized since the boot
+static bool synced = false;
+// the time of a synchronization before the reset is used
+static bool holdover = false;
+// monotonic time of the last synchronization
+static int64_t last_sync = 0;
+// first synchronization of the boot, the drift is
+// estimated against it so the estimate gets better the
+// longer the station runs
+static int64_t anchor_time = 0;
+static int64_t anchor_offset = 0;
+
+// drift of the monotonic clock in ppb, positive if it runs
+// slow
+static int32_t drift = 0;
+static bool drift_valid = false;
+// drift in NVS
+static int32_t stored_drift = 0;
+static nvs_handle_t timesync_nvs;
+static bool nvs_ready = false;
+
+// PRIVATE FUNCTIONS
+
+/** Get the system time in microseconds since the epoch */
+int64_t get_system_time() {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/** Store the drift in NVS if it changed.
+
+**Description**
+    Skip small changes, the estimate moves a little with
+    every synchronization.
+*/
+void store_drift(int32_t value) {
+    if (!nvs_ready || abs(value - stored_drift) <= DRIFT_SAVE_STEP) {
+        return;
+    }
+
+    stored_drift = value;
+    log_status(TAG,
+               nvs_set_i32(timesync_nvs, "drift", value),
+               "store drift");
+    log_status(TAG, nvs_commit(timesync_nvs), "commit drift");
+}
+
+/** Load the drift and the last synchronization.
+
+**Description**
+    Use the drift of the last boots until a new one is
+    estimated. Keep the time of a synchronization before a
+    reset, the system time is lost at a power on.
+*/
+void load_state() {
+    esp_err_t err;
+
+    err = nvs_open("timesync", NVS_READWRITE, &timesync_nvs);
+    nvs_ready = (err == ESP_OK);
+    log_status(TAG, err, "open nvs for the drift");
+    if (nvs_ready && nvs_get_i32(timesync_nvs, "drift", &stored_drift) == ESP_OK) {
+        drift = stored_drift;
+        drift_valid = true;
+        ESP_LOGI(TAG, "drift of the last boot %d ppb", drift);
+    }
+
+    if (esp_reset_reason() != ESP_RST_POWERON &&
+        rtc_state.magic == TIMESYNC_MAGIC &&
+        rtc_state.last_sync <= get_system_time()) {
+        // the system time kept running through the reset.
+        // general follows it until the first sync of this
+        // boot, which steps, so an error of the holdover is
+        // not slewed for hours.
+        holdover = true;
+        ESP_LOGI(TAG, "time kept from before the reset");
+    } else {
+        rtc_state.magic = 0;
+    }
+}
+
+/** Function gets called when sntp has set the time.
+
+**Parameters**
+    - *tv : the new system time
+
+**Description**
+    Take the new offset of the wall clock to the monotonic
+    time for all timestamps, estimate the drift and post
+    `TIMESYNC_EVENT_SYNCED`.
+*/
+void timesync_notification(struct timeval *tv) {
+    int64_t now = esp_timer_get_time();
+    int64_t system = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    int64_t offset = system - now;
+    int32_t estimate;
+    bool estimated = false;
+
+    time_synced();
+
+    portENTER_CRITICAL(&sync_lock);
+    if (!synced) {
+        anchor_time = now;
+        anchor_offset = offset;
+    } else if (now - anchor_time >= DRIFT_MIN_SPAN) {
+        drift = (offset - anchor_offset) * 1000000000 / (now - anchor_time);
+        drift_valid = true;
+        estimated = true;
+    }
+    estimate = drift;
+    synced = true;
+    last_sync = now;
+    rtc_state.last_sync = system;
+    rtc_state.magic = TIMESYNC_MAGIC;
+    portEXIT_CRITICAL(&sync_lock);
+
+    if (estimated) {
+        store_drift(estimate);
+    }
+    ESP_LOGI(TAG, "time synchronized, drift %d ppb", estimate);
+    // wait a little for a full event queue, a held
+    // measurement is also sent by the next measurement
+    log_status(TAG,
+               esp_event_post(TIMESYNC_EVENT,
+                              TIMESYNC_EVENT_SYNCED,
+                              NULL,
+                              0,
+                              POST_TIMEOUT / portTICK_PERIOD_MS),
+               "post TIMESYNC_EVENT_SYNCED");
+}
+
+// getters of the registry entries
+int32_t timesync_get_quality_entry() {
+    return timesync_get_quality();
+}
+
+int32_t timesync_get_drift() {
+    return drift;
+}
+
+static const registry_entry_t quality_entry = {
+    .name = "time_quality",
+    .type = REGISTRY_INT,
+    .get = timesync_get_quality_entry};
+
+static const registry_entry_t uncertainty_entry = {
+    .name = "time_uncertainty",
+    .type = REGISTRY_INT,
+    .get = timesync_get_uncertainty};
+
+static const registry_entry_t drift_entry = {
+    .name = "time_drift",
+    .type = REGISTRY_INT,
+    .get = timesync_get_drift};
+
+// PUBLIC FUNCTIONS
+
+void timesync_init() {
+    uint8_t index = 0;
+
+    load_state();
+
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    for (int s = 0; s < NUM_SERVERS; s++) {
+        if (strlen(servers[s]) > 0) {
+            sntp_setservername(index++, servers[s]);
+        }
+    }
+    sntp_set_sync_interval(CONFIG_TIMESYNC_INTERVAL * 1000);
+    sntp_set_time_sync_notification_cb(timesync_notification);
+
+    registry_register(&quality_entry);
+    registry_register(&uncertainty_entry);
+    registry_register(&drift_entry);
+
+    ESP_LOGI(TAG, "init finished with %d servers", index);
+}
+
+void timesync_handler(void *arg,
+                      esp_event_base_t base,
+                      int32_t id,
+                      void *data) {
+    if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        if (sntp_enabled()) {
+            // request the time now instead of after the
+            // poll interval
+            sntp_restart();
+            ESP_LOGD(TAG, "restarted sntp");
+        } else {
+            sntp_init();
+            ESP_LOGD(TAG, "started sntp");
+        }
+    }
+}
+
+timesync_quality_t timesync_get_quality() {
+    timesync_quality_t quality;
+
+    portENTER_CRITICAL(&sync_lock);
+    if (!synced) {
+        quality = holdover ? TIMESYNC_HOLDOVER : TIMESYNC_NONE;
+    } else if (esp_timer_get_time() - last_sync >
+               (int64_t)STALE_INTERVALS * CONFIG_TIMESYNC_INTERVAL * 1000000) {
+        quality = TIMESYNC_STALE;
+    } else {
+        quality = TIMESYNC_SYNCED;
+    }
+    portEXIT_CRITICAL(&sync_lock);
+    return quality;
+}
+
+int32_t timesync_get_uncertainty() {
+    // read before the lock, gettimeofday takes a lock
+    int64_t system = get_system_time();
+    int64_t elapsed;
+    int64_t rate;
+    int64_t uncertainty;
+
+    portENTER_CRITICAL(&sync_lock);
+    if (synced) {
+        elapsed = esp_timer_get_time() - last_sync;
+    } else if (holdover) {
+        elapsed = system - rtc_state.last_sync;
+    } else {
+        portEXIT_CRITICAL(&sync_lock);
+        return -1;
+    }
+    rate = drift_valid ? llabs(drift) : CONFIG_TIMESYNC_MAX_DRIFT * 1000;
+    portEXIT_CRITICAL(&sync_lock);
+
+    // microseconds times ppb to milliseconds, plus the
+    // correction that is still slewed in
+    uncertainty = CONFIG_TIMESYNC_ACCURACY + elapsed / 1000 * rate / 1000000000 +
+                  get_time_correction() / 1000;
+    return uncertainty > INT32_MAX ? INT32_MAX : uncertainty;
+}
@@ -0,0 +1,95 @@
+// MISCELLANEOUS
+// Header file of the time sync component.
+
+#ifndef _TIMESYNC_H_
+#define _TIMESYNC_H_
+
+#include <stdint.h>
+
+#include "esp_event.h"
+
+// event base
+ESP_EVENT_DECLARE_BASE(TIMESYNC_EVENT);
+
+// event id
+typedef enum {
+    // posted after every synchronization
+    TIMESYNC_EVENT_SYNCED
+} timesync_event_t;
+
+// quality of the last synchronization
+typedef enum {
+    // no synchronization known, the time may count from 1970
+    TIMESYNC_NONE,
+    // the time of a synchronization before the last reset
+    // is kept, not synchronized since
+    TIMESYNC_HOLDOVER,
+    // synchronized, but not within three poll intervals
+    TIMESYNC_STALE,
+    // synchronized within three poll intervals
+    TIMESYNC_SYNCED
+} timesync_quality_t;
+
+/** Initialize the time synchronization.
+
+**Requirements**
+    Initialize NVS first.
+
+**Description**
+    Configure sntp with the servers and the poll interval of
+    the Kconfig. Restore the drift from NVS and the last
+    synchronization from RTC memory, which survives a
+    reset but not a power loss. The system time runs on
+    through a reset, so it is used as holdover until the
+    next synchronization. The holdover does not count as a
+    synchronization for `general`, the first one of the
+    boot steps the time. Register the read only variables
+    `time_quality`, `time_uncertainty` and `time_drift`.
+*/
+void timesync_init();
+
+/** Event handler for the ip events.
+
+**Parameters**
+    - *arg : pointer to arguments of the event
+    - base : event base
+    - id : event id
+    - *data : event data
+
+**Requirements**
+    Handler musst be registered for base `IP_EVENT` and id
+    `IP_EVENT_STA_GOT_IP` on the default event loop.
+
+**Description**
+    Start sntp on the first connection and restart it on a
+    reconnect, which sends a request at once. sntp keeps
+    running while disconnected, so the time and its quality
+    are kept over a lost connection.
+*/
+void timesync_handler(void *arg,
+                      esp_event_base_t base,
+                      int32_t id,
+                      void *data);
+
+/** Get the quality of the time synchronization
+
+**Return**
+    The quality, see `timesync_quality_t`.
+*/
+timesync_quality_t timesync_get_quality();
+
+/** Get the uncertainty of the time
+
+**Return**
+    Estimated maximum error of the wall clock time in
+    milliseconds or -1 without a synchronization.
+
+**Description**
+    The accuracy of a synchronization plus the drift times
+    the time since the last synchronization and the
+    correction that is not slewed in yet. Until the drift
+    is estimated `CONFIG_TIMESYNC_MAX_DRIFT` is assumed.
+*/
+int32_t timesync_get_uncertainty();
+
+#endif  // _TIMESYNC_H_
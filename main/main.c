@@ -7,8 +7,12 @@
 #include "../components/dl_wifi/dl_wifi.h"
 #include "../components/general/general.h"
 #include "../components/heartbeat/heartbeat.h"
+#include "../components/logger/logger.h"
+#include "../components/metrics/metrics.h"
 #include "../components/pl_i2c/pl_i2c.h"
 #include "../components/pl_udp/pl_udp.h"
+#include "../components/scheduler/scheduler.h"
+#include "../components/timesync/timesync.h"
 
 // esp-idf
 // #include "driver/gpio.h"
@@ -31,7 +35,7 @@
 
 // period of the weather station measurements in seconds
 #define MEASUREMENT_RATE 3*3600
-// period of the heartbeat timer in seconds
+// period of the heartbeat in seconds
 #define HEARTBEAT_RATE 3600
 // port for the udp communication
 #define UDP_PORT 50000
@@ -53,12 +57,24 @@ void app_main() {
     ESP_LOGW(TAG, "Hello world!");
 
     esp_log_level_set("user", ESP_LOG_INFO);
+    // set the time zone once
+    init_time();
+
+    // hot paths log into a ring that a low priority task
+    // formats later
+    logger_init();
 
     // create an event loop
     log_status(TAG,
                esp_event_loop_create_default(),
                "esp_event_loop_create_default");
 
+    // the scheduler runs all periodic jobs
+    esp_log_level_set("scheduler", ESP_LOG_INFO);
+    scheduler_init();
+    // latency histograms of the stages of a request
+    metrics_init();
+
 #ifdef ENABLE_BMP180
     esp_log_level_set("pl_i2c", ESP_LOG_INFO);
     esp_log_level_set("al_bmp180", ESP_LOG_INFO);
@@ -69,6 +85,13 @@ void app_main() {
     al_bmp180_init();
 #endif  // ENABLE_BMP180
 
+#ifdef ENABLE_CRYPTO
+    // before the network, the first frames are sent and
+    // received as soon as there is an IP address
+    esp_log_level_set("al_crypto", ESP_LOG_INFO);
+    al_crypto_init();
+#endif  // ENABLE_CRYPTO
+
 #ifdef ENABLE_WIFI
     // show less infos from the internal wifi component
     esp_log_level_set("wifi", ESP_LOG_WARN);
@@ -85,6 +108,13 @@ void app_main() {
                                                    NULL,
                                                    NULL),
                "register wifi events (any)");
+    log_status(TAG,
+               esp_event_handler_instance_register(IP_EVENT,
+                                                   IP_EVENT_STA_GOT_IP,
+                                                   &dl_wifi_handler,
+                                                   NULL,
+                                                   NULL),
+               "register ip event IP_EVENT_STA_GOT_IP for wifi");
     log_status(TAG,
                esp_event_handler_instance_register(IP_EVENT,
                                                    IP_EVENT_STA_GOT_IP,
@@ -92,6 +122,17 @@ void app_main() {
                                                    NULL,
                                                    NULL),
                "register ip event IP_EVENT_STA_GOT_IP");
+    log_status(TAG,
+               esp_event_handler_instance_register(IP_EVENT,
+                                                   IP_EVENT_STA_GOT_IP,
+                                                   &timesync_handler,
+                                                   NULL,
+                                                   NULL),
+               "register ip event IP_EVENT_STA_GOT_IP for timesync");
+
+    // sntp with the drift and the time kept over a reset
+    esp_log_level_set("timesync", ESP_LOG_INFO);
+    timesync_init();
 
     // init the udp component
     pl_udp_init(UDP_PORT);
@@ -111,8 +152,15 @@ void app_main() {
                                                    NULL,
                                                    NULL),
                "register heartbeat event HEARTBEAT_EVENT_SEND_handler");
+    log_status(TAG,
+               esp_event_handler_instance_register(HEARTBEAT_EVENT,
+                                                   HEARTBEAT_EVENT_HEALTH,
+                                                   &heartbeat_handler,
+                                                   NULL,
+                                                   NULL),
+               "register heartbeat event HEARTBEAT_EVENT_HEALTH handler");
 
-    // init and start the heartbeat timer
+    // init and start the heartbeat job
     heartbeat_set_period(HEARTBEAT_RATE);
     heartbeat_init();
     heartbeat_start();
@@ -130,18 +178,20 @@ void app_main() {
                                                    NULL,
                                                    NULL),
                "register udp event UDP_EVENT_RECEIVED handler");
+    // send a measurement held back until the time is known
+    log_status(TAG,
+               esp_event_handler_instance_register(TIMESYNC_EVENT,
+                                                   TIMESYNC_EVENT_SYNCED,
+                                                   &al_weather_station_time_handler,
+                                                   NULL,
+                                                   NULL),
+               "register timesync event TIMESYNC_EVENT_SYNCED handler");
 
-    // init and start the measurement timer
+    // init and start the measurement job
     al_weather_station_init();
     al_weather_station_start(MEASUREMENT_RATE);
 #endif  // ENABLE_WEATHER_STATION
 
-#ifdef ENABLE_CRYPTO
-    esp_log_level_set("al_crypto", ESP_LOG_INFO);
-    al_crypto_init();
-
-#endif  // ENABLE_CRYPTO
-
     while (1) {
         vTaskDelay(5000 / portTICK_PERIOD_MS);
     }
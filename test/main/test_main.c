@@ -0,0 +1,10 @@
+// MAIN FILE
+// Test app of the components.
+
+#include "unity.h"
+
+void app_main(void) {
+    // the menu lists the test cases of `TEST_COMPONENTS` and
+    // runs them by name, number or tag
+    unity_run_menu();
+}